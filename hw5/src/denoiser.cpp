@@ -1,105 +1,645 @@
 #include "denoiser.h"
+#include "filterkernel.h"
+#include "util/trace.h"
 
-Denoiser::Denoiser() : m_useTemportal(false) {}
+#include <chrono>
+#include <iomanip>
 
-void Denoiser::Reprojection(const FrameInfo &frameInfo) {
-    int height = m_accColor.m_height;
-    int width = m_accColor.m_width;
+Denoiser::Denoiser() : m_useTemportal(false), m_simdLevel(DetectSimdLevel()) {}
+
+// Seconds since start
+static double Seconds(const std::chrono::steady_clock::time_point &start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void Denoiser::BuildReprojectionPlan(const FrameInfo &frameInfo) {
+    const std::vector<Matrix4x4> &curMatrix = frameInfo.m_matrix;
+    const std::vector<Matrix4x4> &preMatrix = m_history.m_matrix;
+    Matrix4x4 preWorldToScreen = preMatrix[preMatrix.size() - 1];
+
+    // The last two matrices are view and world-to-screen, the rest are per object
+    int objectNum = static_cast<int>(std::min(curMatrix.size(), preMatrix.size())) - 2;
+    m_reprojectionPlan.resize(std::max(objectNum, 0));
+    for (int object = 0; object < objectNum; object++) {
+        Matrix4x4 m = curMatrix[object];
+
+        // P_(i-1) * V_(i-1)* M_(i-1) * M_i^(-1) * world
+        m = m.IsAffine() ? InverseAffine(m) : Inverse(m);
+        m = preMatrix[object] * m;
+        m = preWorldToScreen * m;
+        m_reprojectionPlan[object] = m;
+    }
+}
+
+template <typename Color>
+bool Denoiser::ReprojectPixel(const FrameView &frame, const ObjectIdView &preId,
+                              const PlanarView2D<const Color> &accColor, const int &x,
+                              const int &y, Float3 &motion, Float3 &history) const {
+    int height = accColor.m_height;
+    int width = accColor.m_width;
+
+    int object = frame.id(x, y);
+    if (object < 0 || object >= static_cast<int>(m_reprojectionPlan.size())) {
+        motion = Float3(0.f);
+        history = Float3(0.f);
+        return false;
+    }
+
+    const Matrix4x4 &m = m_reprojectionPlan[object];
+    Float3 screen = m(frame.Position(x, y), Float3::Point);
+
+    // Check if out-of-bounds (or NaN, the views below are unchecked) or different
+    // object ID
+    bool inside = screen.x >= 0 && screen.x <= (width - 1) && screen.y >= 0 &&
+                  screen.y <= (height - 1);
+    bool invalid = !inside || (object != preId(screen.x, screen.y));
+
+    motion = Float3(screen.x - x, screen.y - y, invalid ? 0.f : 1.f);
+    history = invalid ? Float3(0.f) : accColor(screen.x, screen.y);
+    return !invalid;
+}
 
-    Matrix4x4 preWorldToScreen = m_preFrameInfo.m_matrix[m_preFrameInfo.m_matrix.size() - 1];
-    Matrix4x4 preWorldToCamera = m_preFrameInfo.m_matrix[m_preFrameInfo.m_matrix.size() - 2];
+// Rows of a band of the temporal passes
+static const int kTemporalBandHeight = 64;
+
+template <typename Color>
+void Denoiser::ReprojectionBand(const FrameView &frame,
+                                const PlanarBuffer2D<Color> &accColor,
+                                PlanarBuffer2D<Color> &history, const int &band) {
+    TRACE_FRAME_SCOPE("ReprojectionBand", m_frameCount);
+    int height = accColor.m_height;
+    int width = accColor.m_width;
+    int y0 = band * kTemporalBandHeight;
+    int y1 = std::min(height, y0 + kTemporalBandHeight);
+
+    // Background pixels are not in the work list, give them what ReprojectPixel
+    // would return for them: no motion and no history
+    if (m_rowWork.m_pixelCount < static_cast<long long>(width) * height) {
+        size_t offset = static_cast<size_t>(y0) * width;
+        size_t count = static_cast<size_t>(y1 - y0) * width;
+        std::fill_n(m_valid.m_buffer.get() + offset, count, false);
+        for (int c = 0; c < 3; c++) {
+            std::fill_n(m_motion.Plane(c) + offset, count, 0.f);
+            std::fill_n(history.Plane(c) + offset, count, ChannelFromFloat<Color>(0.f));
+        }
+    }
+
+    ObjectIdView preId = m_history.IdView();
+    PlanarView2D<const Color> preColor = accColor.View();
+    BufferView2D<bool> valid = m_valid.View();
+    PlanarView2D<float> motionOut = m_motion.View();
+    PlanarView2D<Color> historyOut = history.View();
+    for (int y = y0; y < y1; y++) {
+        for (const Span *span = m_rowWork.RowBegin(y); span != m_rowWork.RowEnd(y);
+             span++) {
+            for (int x = span->x0; x < span->x1; x++) {
+                // TODO: Reproject
+                Float3 motion, color;
+                valid(x, y) = ReprojectPixel(frame, preId, preColor, x, y, motion, color);
+                motionOut.Set(x, y, motion);
+                historyOut.Set(x, y, color);
+            }
+        }
+    }
+}
+
+Float3 Denoiser::ClampAndBlend(const Float3 &X, const Float3 &X_sqr, const float &weight,
+                               const Float3 &preColor, const Float3 &curColor) const {
+    if (weight == 0.f) {
+        return curColor;
+    }
+
+    Float3 miu = X / weight;
+    Float3 sigma = SafeSqrt(X_sqr / weight - miu * miu);
+
+    // Clamp
+    Float3 prevColor =
+        Clamp(preColor, miu - sigma * m_colorBoxK, miu + sigma * m_colorBoxK);
+
+    // TODO: Exponential moving average
+    return Lerp(prevColor, curColor, m_alpha);
+}
 
-    #pragma omp parallel for
-    for (int y = 0; y < height; y++) {
+// Ring of rows and column sums of one band of AccumulationBand
+struct TemporalBandRings {
+    std::vector<Float3> history;
+    std::vector<bool> valid;
+    std::vector<float> rowSum, rowSqrSum, rowCount;
+    std::vector<double> sum, sqrSum, count;
+};
+
+template <typename Color>
+void Denoiser::AccumulationBand(const FrameView *frame,
+                                const PlanarView2D<const float> &curColor,
+                                const PlanarBuffer2D<Color> &accColor,
+                                PlanarBuffer2D<Color> &out, const int &band) {
+    TRACE_FRAME_SCOPE("AccumulationBand", m_frameCount);
+    int height = out.m_height;
+    int width = out.m_width;
+    int kernelRadius = m_clampRadius;
+    int window = 2 * kernelRadius + 1;
+    bool sparse = m_rowWork.m_pixelCount < static_cast<long long>(width) * height;
+    bool reproject = frame != nullptr;
+    int y0 = band * kTemporalBandHeight;
+    int y1 = std::min(height, y0 + kTemporalBandHeight);
+    ObjectIdView preId = m_history.IdView();
+    PlanarView2D<const Color> preColor = accColor.View();
+    PlanarView2D<float> motionOut = m_motion.View();
+    PlanarView2D<Color> result = out.View();
+
+    // Background pixels have no history and keep the current color. Only the gaps
+    // between the spans are written, the spans may still hold their history.
+    if (sparse) {
+        auto keep = [&](const int &y, const int &x0, const int &x1) {
+            for (int c = 0; c < 3; c++) {
+                ConvertChannels(curColor.Row(c, y) + x0, result.Row(c, y) + x0, x1 - x0);
+            }
+        };
+        for (int y = y0; y < y1; y++) {
+            int x = 0;
+            for (const Span *span = m_rowWork.RowBegin(y); span != m_rowWork.RowEnd(y);
+                 span++) {
+                keep(y, x, span->x0);
+                x = span->x1;
+            }
+            keep(y, x, width);
+        }
+    }
+
+    // Clamp statistics over the valid pixels of a (2r+1)^2 window, computed as
+    // separable sliding-window sums so the cost per pixel does not depend on r. The
+    // band keeps a ring of the 2r+1 rows around the current one: the horizontal
+    // window sums of the valid neighbours, and the history when reprojecting. Rows
+    // within r of a band edge are summed (and reprojected) by both bands.
+    // Per-thread storage outlives the frame, so bands only allocate while it grows.
+    static thread_local TemporalBandRings rings;
+    std::vector<Float3> &history = rings.history;
+    std::vector<bool> &valid = rings.valid;
+    std::vector<float> &rowSum = rings.rowSum, &rowSqrSum = rings.rowSqrSum;
+    std::vector<float> &rowCount = rings.rowCount;
+    std::vector<double> &sum = rings.sum, &sqrSum = rings.sqrSum;
+    std::vector<double> &count = rings.count;
+    history.assign(reproject ? window * width : 0, Float3(0.f));
+    valid.assign(reproject ? width : 0, false);
+    rowSum.assign(window * width * 3, 0.f);
+    rowSqrSum.assign(window * width * 3, 0.f);
+    rowCount.assign(window * width, 0.f);
+    sum.assign(width * 3, 0.0);
+    sqrSum.assign(width * 3, 0.0);
+    count.assign(width, 0.0);
+
+    // Horizontal window sums of row l into its ring slot, added to the columns
+    auto addRowSums = [&](const int &l, const int &slot, const auto &rowValid) {
+        const float *color[3] = {curColor.Row(0, l), curColor.Row(1, l),
+                                 curColor.Row(2, l)};
+        double hsum[3] = {0, 0, 0}, hsqrSum[3] = {0, 0, 0};
+        int hcount = 0;
+        auto slide = [&](const int &k, const int &sign) {
+            if (k < 0 || k >= width || !rowValid[k]) return;
+            for (int c = 0; c < 3; c++) {
+                hsum[c] += sign * color[c][k];
+                hsqrSum[c] += sign * color[c][k] * color[c][k];
+            }
+            hcount += sign;
+        };
+        for (int k = 0; k < kernelRadius; k++) {
+            slide(k, 1);
+        }
         for (int x = 0; x < width; x++) {
-            // TODO: Reproject
+            slide(x + kernelRadius, 1);
+            for (int c = 0; c < 3; c++) {
+                rowSum[(slot + x) * 3 + c] = hsum[c];
+                rowSqrSum[(slot + x) * 3 + c] = hsqrSum[c];
+                sum[x * 3 + c] += rowSum[(slot + x) * 3 + c];
+                sqrSum[x * 3 + c] += rowSqrSum[(slot + x) * 3 + c];
+            }
+            rowCount[slot + x] = hcount;
+            count[x] += hcount;
+            slide(x - kernelRadius, -1);
+        }
+    };
 
-            int object = frameInfo.m_id(x, y);
-            if (object < 0) {
-                m_valid(x, y) = false;
-                m_misc(x, y) = Float3(0.f);
-                continue;
+    // Bring row l into the ring, reprojecting it first in the fused pass
+    auto enter = [&](const int &l) {
+        int slot = (l % window) * width;
+        if (!reproject) {
+            addRowSums(l, slot, m_valid.View().Row(l));
+            return;
+        }
+        if (sparse) {
+            std::fill(valid.begin(), valid.end(), false);
+            std::fill_n(history.begin() + slot, width, Float3(0.f));
+            if (l >= y0 && l < y1) {
+                for (int c = 0; c < 3; c++) {
+                    std::fill_n(motionOut.Row(c, l), width, 0.f);
+                }
             }
+        }
+        for (const Span *span = m_rowWork.RowBegin(l); span != m_rowWork.RowEnd(l);
+             span++) {
+            for (int x = span->x0; x < span->x1; x++) {
+                Float3 motion;
+                valid[x] = ReprojectPixel(*frame, preId, preColor, x, l, motion,
+                                          history[slot + x]);
+                if (l >= y0 && l < y1) {
+                    motionOut.Set(x, l, motion);
+                }
+            }
+        }
+        addRowSums(l, slot, valid);
+    };
 
-            Matrix4x4 m = frameInfo.m_matrix[object];
+    // Remove the window sums of row l from the columns
+    auto leave = [&](const int &l) {
+        int slot = (l % window) * width;
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                sum[x * 3 + c] -= rowSum[(slot + x) * 3 + c];
+                sqrSum[x * 3 + c] -= rowSqrSum[(slot + x) * 3 + c];
+            }
+            count[x] -= rowCount[slot + x];
+        }
+    };
 
-            // P_(i-1) * V_(i-1)* M_(i-1) * M_i^(-1) * world
-            m = Inverse(m);
-            m = m_preFrameInfo.m_matrix[object] * m;
-            m = preWorldToScreen * m;
+    int lmin = std::max(0, y0 - kernelRadius);
+    int lmax = std::min(height, y0 + kernelRadius);
+    for (int l = lmin; l < lmax; l++) {
+        enter(l);
+    }
+    for (int y = y0; y < y1; y++) {
+        if (y + kernelRadius < height) {
+            enter(y + kernelRadius);
+        }
 
-            Float3 screen = m(frameInfo.m_position(x, y), Float3::Point);
+        int slot = (y % window) * width;
+        for (const Span *span = m_rowWork.RowBegin(y); span != m_rowWork.RowEnd(y);
+             span++) {
+            for (int x = span->x0; x < span->x1; x++) {
+                // TODO: Temporal clamp
 
-            // Check if out-of-bounds or different object ID
-            bool invalid = screen.x < 0 || screen.x > (width - 1) || screen.y < 0 || screen.y > (height - 1);
-            invalid = invalid || (object != m_preFrameInfo.m_id(screen.x, screen.y));
+                // Statistics
+                Float3 X(sum[x * 3 + 0], sum[x * 3 + 1], sum[x * 3 + 2]);
+                Float3 X_sqr(sqrSum[x * 3 + 0], sqrSum[x * 3 + 1], sqrSum[x * 3 + 2]);
+                Float3 previous = reproject ? history[slot + x] : result(x, y);
+                result.Set(x, y, ClampAndBlend(X, X_sqr, count[x], previous,
+                                               curColor(x, y)));
+            }
+        }
 
-            m_valid(x, y) = !invalid;
-            m_misc(x, y) = invalid ? Float3(0.f) : m_accColor(screen.x, screen.y);
+        if (y - kernelRadius >= 0) {
+            leave(y - kernelRadius);
         }
     }
+}
 
-    std::swap(m_misc, m_accColor);
+// Band stage calling band(b, color)
+template <typename Band>
+static TemporalBandStage MakeBandStage(const Band &band, const char *name,
+                                       PerfCounts &counts, const int &bandNum,
+                                       const int &radius, const bool &readsColor) {
+    TemporalBandStage stage = {};
+    stage.func = [](const void *context, const int &b,
+                    const PlanarView2D<const float> &color) {
+        (*static_cast<const Band *>(context))(b, color);
+    };
+    stage.context = &band;
+    stage.name = name;
+    stage.counts = &counts;
+    stage.bandHeight = kTemporalBandHeight;
+    stage.bandNum = bandNum;
+    stage.radius = radius;
+    stage.readsColor = readsColor;
+    return stage;
 }
 
-void Denoiser::TemporalAccumulation(const Buffer2D<Float3> &curFilteredColor) {
-    int height = m_accColor.m_height;
-    int width = m_accColor.m_width;
-    int kernelRadius = 3;
+template <typename Color>
+void Denoiser::TemporalPasses(const FrameInfo &frameInfo,
+                              const PlanarBuffer2D<float> *curFilteredColor,
+                              const unsigned &passes, PlanarBuffer2D<Color> &accColor,
+                              PlanarBuffer2D<Color> &misc) {
+    int bandNum = (accColor.m_height + kTemporalBandHeight - 1) / kTemporalBandHeight;
+    if (passes & (kReprojectionPass | kFusedTemporalPass)) {
+        BuildReprojectionPlan(frameInfo);
+    }
 
-    #pragma omp parallel for
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            // TODO: Temporal clamp
+    // Reprojection writes the history into misc, and accumulation blends it there in
+    // place (a pixel only reads its own history), so a band of one waits for a few
+    // bands of the other, not for all of them. The fused pass reads accColor and
+    // writes misc. Either way misc then becomes the accumulated color.
+    FrameView frame(frameInfo);
+    auto reproject = [&](const int &b, const PlanarView2D<const float> &) {
+        ReprojectionBand(frame, accColor, misc, b);
+    };
+    auto accumulate = [&](const int &b, const PlanarView2D<const float> &color) {
+        AccumulationBand(nullptr, color, accColor, misc, b);
+    };
+    auto fused = [&](const int &b, const PlanarView2D<const float> &color) {
+        AccumulationBand(&frame, color, accColor, misc, b);
+    };
+    std::vector<TemporalBandStage> &stages =
+        passes & kFilterPass ? m_filterBandStages : m_bandStages;
+    if (passes & kReprojectionPass) {
+        stages.push_back(MakeBandStage(reproject, "Reprojection", m_reprojectionCounts,
+                                       bandNum, 0, false));
+    }
+    if (passes & kAccumulationPass) {
+        stages.push_back(MakeBandStage(accumulate, "TemporalAccumulation",
+                                       m_accumulationCounts, bandNum, m_clampRadius,
+                                       true));
+    }
+    if (passes & kFusedTemporalPass) {
+        stages.push_back(MakeBandStage(fused, "FusedTemporalAccumulation",
+                                       m_accumulationCounts, bandNum, m_clampRadius,
+                                       true));
+    }
 
-            int kmin = std::max(0, x - kernelRadius);
-            int kmax = std::min(width, x + kernelRadius + 1);
+    if (passes & kFilterPass) {
+        Filter(frameInfo);
+    } else {
+        PlanarView2D<const float> color = {};
+        if (curFilteredColor != nullptr) {
+            color = curFilteredColor->View();
+        }
+        RunBandStages(stages, color);
+    }
+    stages.clear();
 
-            int lmin = std::max(0, y - kernelRadius);
-            int lmax = std::min(height, y + kernelRadius + 1);
+    if (passes & (kAccumulationPass | kFusedTemporalPass)) {
+        std::swap(misc, accColor);
+    }
+}
+
+void Denoiser::TemporalPasses(const FrameInfo &frameInfo,
+                              const PlanarBuffer2D<float> *curFilteredColor,
+                              const unsigned &passes) {
+    if (m_colorPrecision == Precision::Half) {
+        TemporalPasses(frameInfo, curFilteredColor, passes, m_accColorHalf, m_miscHalf);
+    } else {
+        TemporalPasses(frameInfo, curFilteredColor, passes, m_accColor, m_misc);
+    }
+}
 
-            
-            // Statistics
-            Float3 X;
-            Float3 X_sqr;
-            float weight = 0.f;
+void Denoiser::Reprojection(const FrameInfo &frameInfo) {
+    TemporalPasses(frameInfo, nullptr, kReprojectionPass);
+}
 
-            for (int l = lmin; l < lmax; l++) {
-                for (int k = kmin; k < kmax; k++) {
-                    if (!m_valid(k, l)) continue;
-                    X += curFilteredColor(k, l);
-                    X_sqr += curFilteredColor(k, l) * curFilteredColor(k, l);
-                    weight += 1;
+void Denoiser::TemporalAccumulation(const FrameInfo &frameInfo,
+                                    const PlanarBuffer2D<float> &curFilteredColor) {
+    TemporalPasses(frameInfo, &curFilteredColor, kAccumulationPass);
+}
+
+void Denoiser::FusedTemporalAccumulation(const FrameInfo &frameInfo,
+                                         const PlanarBuffer2D<float> &curFilteredColor) {
+    TemporalPasses(frameInfo, &curFilteredColor, kFusedTemporalPass);
+}
+
+float Denoiser::JointBilateralWeight(const float &sqrPixelDist, const Float3 &centerColor,
+                                     const Float3 &tapColor, const Float3 &centerNormal,
+                                     const Float3 &tapNormal, const Float3 &centerPos,
+                                     const Float3 &tapPos) const {
+    // Coordinate difference
+    float dpix = sqrPixelDist;
+    dpix /= m_sigmaCoord;
+
+    // Color difference
+    float dbeauty = SqrDistance(centerColor, tapColor);
+    dbeauty /= m_sigmaColor;
+
+    // Normal difference (don't want differently oriented pixels to affect each other
+    float dnormal = 0.f;
+    if (m_sigmaNormal > 0) {
+        dnormal = SafeAcos(Dot(centerNormal, tapNormal)); // acos 0 to 1, so 90 to 0 deg
+        dnormal *= dnormal;
+        dnormal /= m_sigmaNormal;
+    }
+
+    // Plane difference (better than simple depth comparison)
+    float dplane = 0.f;
+    if (m_sigmaPlane > 0) {
+        Float3 upos = tapPos - centerPos;
+        float lpos = Length(upos);
+        if (lpos > 0) upos /= lpos;
+        dplane = Dot(centerNormal, upos);
+        dplane *= dplane;
+        dplane /= m_sigmaPlane;
+    }
+
+    float J = dpix + dbeauty + dnormal + dplane;
+    J *= -0.5;
+    return exp(J);
+}
+
+int Denoiser::FilterBytesPerTap(const bool &compact) const {
+    int guideSize = m_guidePrecision == Precision::Half ? sizeof(Half) : sizeof(float);
+    // Beauty, normal and position
+    if (compact) {
+        return 3 * guideSize + sizeof(uint32_t) + sizeof(float);
+    }
+    return 6 * guideSize + 3 * sizeof(float);
+}
+
+int Denoiser::ReprojectionBytesPerPixel(const bool &compact) const {
+    // ID and position, and the ID of the previous frame at the reprojected pixel
+    int historySize = compact || m_compactHistory ? sizeof(uint16_t) : sizeof(float);
+    if (compact) {
+        return sizeof(uint16_t) + sizeof(float) + historySize;
+    }
+    return sizeof(float) + 3 * sizeof(float) + historySize;
+}
+
+int Denoiser::FilterTileSize(const bool &compact) const {
+    // Task graph tiles need a bounded neighbourhood, whole rows have too many
+    if (m_tileSize < 0 || (m_tileSize == 0 && m_tilePipeline)) {
+        return ChooseTileSize(m_kernelRadius, FilterBytesPerTap(compact));
+    }
+    return m_tileSize;
+}
+
+void Denoiser::FilterTiles(const int &width, const int &height, const bool &compact,
+                           std::vector<Tile> &tiles) const {
+    MakeTiles(width, height, FilterTileSize(compact), tiles);
+}
+
+// Task of RunFilterPasses: task index pass * tileNum + tile filters the spans of tile
+template <typename FilterSpan>
+struct FilterTileTask {
+    static void Run(const void *context, const int &index) {
+        const FilterTileTask &task = *static_cast<const FilterTileTask *>(context);
+        int pass = index / task.tileNum;
+        int tile = index % task.tileNum;
+        const WorkList &work = *task.work;
+        for (int i = work.m_tileBegin[tile]; i < work.m_tileBegin[tile + 1]; i++) {
+            (*task.filterSpan)(pass, work.m_spans[i]);
+        }
+    }
+
+    const FilterSpan *filterSpan;
+    const WorkList *work;
+    int tileNum;
+};
+
+// Add the bands of stages on color to graph. A band waits for the bands of the stage
+// before within its radius and, if it reads the color, for the tasks
+// afterFilter(y0, y1, task) adds edges from, which write rows [y0, y1) of it.
+template <typename AfterFilter>
+static void AddBandTasks(TaskGraph &graph, std::vector<TemporalBandStage> &stages,
+                         const PlanarView2D<const float> &color,
+                         const AfterFilter &afterFilter) {
+    int before = -1; // first task of the stage before
+    for (size_t s = 0; s < stages.size(); s++) {
+        TemporalBandStage &stage = stages[s];
+        stage.color = color;
+        int first = graph.TaskCount();
+        for (int b = 0; b < stage.bandNum; b++) {
+            int task = graph.AddTask(&TemporalBandStage::Run, &stage, b);
+            int y0 = std::max(0, b * stage.bandHeight - stage.radius);
+            int y1 = (b + 1) * stage.bandHeight + stage.radius;
+            if (before >= 0) {
+                const TemporalBandStage &previous = stages[s - 1];
+                int end = std::min(previous.bandNum, (y1 + previous.bandHeight - 1) /
+                                                         previous.bandHeight);
+                for (int i = y0 / previous.bandHeight; i < end; i++) {
+                    graph.AddEdge(before + i, task);
                 }
             }
-            if (weight == 0.f) {
-                m_misc(x, y) = curFilteredColor(x, y);
-                continue;
+            if (stage.readsColor) {
+                afterFilter(y0, y1, task);
+            }
+        }
+        before = first;
+    }
+}
+
+void Denoiser::RunBandStages(std::vector<TemporalBandStage> &stages,
+                             const PlanarView2D<const float> &color) {
+    if (!m_tilePipeline) {
+        for (const TemporalBandStage &stage : stages) {
+            TRACE_FRAME_SCOPE(stage.name, m_frameCount);
+            PerfScope perf(*stage.counts, m_perfCounters);
+            #pragma omp parallel for schedule(dynamic)
+            for (int b = 0; b < stage.bandNum; b++) {
+                stage.func(stage.context, b, color);
             }
-            
-            Float3 miu = X / weight;
-            Float3 sigma = SafeSqrt(X_sqr / weight - miu * miu); 
+        }
+        return;
+    }
+
+    TRACE_FRAME_SCOPE("TemporalGraph", m_frameCount);
+    TaskGraph &graph = m_temporalGraph;
+    graph.Clear();
+    AddBandTasks(graph, stages, color, [](const int &, const int &, const int &) {});
+    GetTaskScheduler().Run(graph);
+}
+
+template <typename PassRadius, typename FilterSpan>
+void Denoiser::RunFilterPasses(const FrameInfo &frameInfo, const int &passNum,
+                               const PassRadius &passRadius,
+                               const PlanarBuffer2D<float> &output,
+                               const FilterSpan &filterSpan) {
+    if (!m_tilePipeline) {
+        for (int pass = 0; pass < passNum; pass++) {
+            ParallelForSpans(m_filterWork,
+                             [&](const Span &span) { filterSpan(pass, span); });
+        }
+        RunBandStages(m_filterBandStages, output.View());
+        return;
+    }
 
-            // Clamp
-            Float3 prevColor = Clamp(m_accColor(x, y), miu - sigma * m_colorBoxK, miu + sigma * m_colorBoxK);
+    int height = frameInfo.m_beauty.m_height;
+    int width = frameInfo.m_beauty.m_width;
+    int tileSize = FilterTileSize(frameInfo.IsCompact());
+    int tileNum = static_cast<int>(m_filterTiles.size());
+    FilterTileTask<FilterSpan> filterTask = {&filterSpan, &m_filterWork, tileNum};
 
-            // TODO: Exponential moving average
-            m_misc(x, y) = Lerp(prevColor, curFilteredColor(x, y), m_alpha);
+    // Task pass * tileNum + tile waits for the tiles of the pass before that it reads.
+    // Those also cover the ones that read what it overwrites (two passes back), as
+    // the reach of the passes grows.
+    TaskGraph &graph = m_filterGraph;
+    graph.Clear();
+    for (int pass = 0; pass < passNum; pass++) {
+        int radius = passRadius(pass);
+        for (int t = 0; t < tileNum; t++) {
+            int task = graph.AddTask(&FilterTileTask<FilterSpan>::Run, &filterTask,
+                                     pass * tileNum + t);
+            if (pass == 0) {
+                continue;
+            }
+            const Tile &tile = m_filterTiles[t];
+            auto after = [&](const int &before) {
+                graph.AddEdge((pass - 1) * tileNum + before, task);
+            };
+            ForTilesOverlapping(width, height, tileSize, tile.x0 - radius,
+                                tile.y0 - radius, tile.x1 + radius, tile.y1 + radius,
+                                after);
         }
     }
 
-    std::swap(m_misc, m_accColor);
+    // Temporal bands reading the filtered color wait for the last pass around them
+    int lastPass = (passNum - 1) * tileNum;
+    auto afterFilter = [&](const int &y0, const int &y1, const int &task) {
+        auto after = [&](const int &before) { graph.AddEdge(lastPass + before, task); };
+        ForTilesOverlapping(width, height, tileSize, 0, y0, width, y1, after);
+    };
+    AddBandTasks(graph, m_filterBandStages, output.View(), afterFilter);
+    GetTaskScheduler().Run(graph);
 }
 
-Buffer2D<Float3> Denoiser::Filter(const FrameInfo &frameInfo) {
+void Denoiser::BuildFilterWork(const FrameInfo &frameInfo) {
+    TRACE_FRAME_SCOPE("BuildFilterWork", m_filteredFrameCount);
     int height = frameInfo.m_beauty.m_height;
     int width = frameInfo.m_beauty.m_width;
-    Buffer2D<Float3> filteredImage = CreateBuffer2D<Float3>(width, height);
-    int kernelRadius = 16;
+    // Rebuilt in place, so only a growing frame allocates
+    bool compact = frameInfo.IsCompact();
+    FilterTiles(width, height, compact, m_filterTiles);
+    if (compact) {
+        const Buffer2D<uint16_t> *id =
+            m_skipBackground ? &frameInfo.m_compact.m_id : nullptr;
+        BuildWorkList(m_filterTiles, height, id, m_filterWork);
+    } else {
+        const Buffer2D<float> *id = m_skipBackground ? &frameInfo.m_id : nullptr;
+        BuildWorkList(m_filterTiles, height, id, m_filterWork);
+    }
+}
 
-    #pragma omp parallel for
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
+void Denoiser::BuildRowWork(const FrameInfo &frameInfo) {
+    TRACE_FRAME_SCOPE("BuildRowWork", m_frameCount);
+    int height = frameInfo.m_beauty.m_height;
+    int width = frameInfo.m_beauty.m_width;
+    MakeTiles(width, height, 0, m_rowTiles);
+    if (frameInfo.IsCompact()) {
+        const Buffer2D<uint16_t> *id =
+            m_skipBackground ? &frameInfo.m_compact.m_id : nullptr;
+        BuildWorkList(m_rowTiles, height, id, m_rowWork);
+    } else {
+        const Buffer2D<float> *id = m_skipBackground ? &frameInfo.m_id : nullptr;
+        BuildWorkList(m_rowTiles, height, id, m_rowWork);
+    }
+}
+
+template <typename Guide, typename Geometry>
+PlanarBuffer2D<float> Denoiser::JointBilateralFilter(const FrameInfo &frameInfo,
+                                                     const PlanarBuffer2D<Guide> &beauty,
+                                                     const Geometry &geometry) {
+    int height = frameInfo.m_beauty.m_height;
+    int width = frameInfo.m_beauty.m_width;
+    int kernelRadius = m_kernelRadius;
+
+    // Pixels left out of the work list (background) keep the noisy color
+    PlanarBuffer2D<float> filteredImage;
+    filteredImage.Copy(frameInfo.m_beauty);
+    PlanarView2D<const Guide> guide = beauty.View();
+    PlanarView2D<const float> noisy = frameInfo.m_beauty.View();
+    PlanarView2D<float> out = filteredImage.View();
+    // Guides of terms that are off are not read, they need not be loaded
+    bool readNormal = m_sigmaNormal > 0 || m_sigmaPlane > 0;
+    bool readPosition = m_sigmaPlane > 0;
+
+    // One pass, it reads no filter output
+    auto noReach = [](const int &) { return 0; };
+    auto filterPixels = [&](const int &, const Span &span) {
+        int y = span.y;
+        for (int x = span.x0; x < span.x1; x++) {
             // TODO: Joint bilateral filter
 
             int kmin = std::max(0, x - kernelRadius);
@@ -110,80 +650,479 @@ Buffer2D<Float3> Denoiser::Filter(const FrameInfo &frameInfo) {
 
             Float3 sum_values;
             float sum_weights = 0.f;
+            Float3 centerColor = guide(x, y);
+            Float3 centerNormal = readNormal ? geometry.Normal(x, y) : Float3(0.f);
+            Float3 centerPos = readPosition ? geometry.Position(x, y) : Float3(0.f);
 
             for (int l = lmin; l < lmax; l++) {
                 for (int k = kmin; k < kmax; k++) {
-                    // Coordinate difference
-                    float dpix = SqrDistance(Float3(x, y, 0), Float3(k, l, 0));
-                    dpix /= m_sigmaCoord;
-
-                    // Color difference
-                    float dbeauty = SqrDistance(frameInfo.m_beauty(x, y), frameInfo.m_beauty(k, l));
-                    dbeauty /= m_sigmaColor;
-
-                    // Normal difference (don't want differently oriented pixels to affect each other
-                    float dnormal = SafeAcos(Dot(frameInfo.m_normal(x, y), frameInfo.m_normal(k, l))); // acos 0 to 1, so 90 to 0 deg
-                    dnormal *= dnormal;
-                    dnormal /= m_sigmaNormal;
-
-                    // Plane difference (better than simple depth comparison)
-                    Float3 upos = frameInfo.m_position(k, l) - frameInfo.m_position(x, y);
-                    float lpos = Length(upos);
-                    if (lpos > 0) upos /= lpos;
-                    float dplane = Dot(frameInfo.m_normal(x, y), upos);
-                    dplane *= dplane;
-                    dplane /= m_sigmaPlane;
-
-                    float J = dpix + dbeauty + dnormal + dplane;
-                    J *= -0.5;
-                    J = exp(J);
-
-                    sum_values += frameInfo.m_beauty(k, l) * J;
+                    Float3 tapColor = guide(k, l);
+                    float J = JointBilateralWeight(
+                        SqrDistance(Float3(x, y, 0), Float3(k, l, 0)), centerColor,
+                        tapColor, centerNormal,
+                        readNormal ? geometry.Normal(k, l) : Float3(0.f), centerPos,
+                        readPosition ? geometry.Position(k, l) : Float3(0.f));
+
+                    sum_values += tapColor * J;
                     sum_weights += J;
                 }
             }
 
             if (sum_weights > 0) {
                 sum_values /= sum_weights;
-                filteredImage(x, y) = sum_values;
+                out.Set(x, y, sum_values);
             } else {
-                filteredImage(x, y) = frameInfo.m_beauty(x, y);
+                out.Set(x, y, noisy(x, y));
             }
         }
+    };
+    RunFilterPasses(frameInfo, 1, noReach, filteredImage, filterPixels);
+
+    return filteredImage;
+}
+
+PlanarBuffer2D<float> Denoiser::JointBilateralFilter(const FrameInfo &frameInfo) {
+    bool halfGuides = m_guidePrecision == Precision::Half;
+    if (frameInfo.IsCompact()) {
+        CompactGeometry geometry(frameInfo.m_compact);
+        if (halfGuides) {
+            return JointBilateralFilter(
+                frameInfo, ConvertPlanarBuffer2D<Half>(frameInfo.m_beauty), geometry);
+        }
+        return JointBilateralFilter(frameInfo, frameInfo.m_beauty, geometry);
+    }
+    if (halfGuides) {
+        PlanarBuffer2D<Half> normal = ConvertPlanarBuffer2D<Half>(frameInfo.m_normal);
+        PlanarGeometry<Half> geometry(normal, frameInfo.m_position);
+        return JointBilateralFilter(
+            frameInfo, ConvertPlanarBuffer2D<Half>(frameInfo.m_beauty), geometry);
+    }
+    PlanarGeometry<float> geometry(frameInfo.m_normal, frameInfo.m_position);
+    return JointBilateralFilter(frameInfo, frameInfo.m_beauty, geometry);
+}
+
+PlanarBuffer2D<float> Denoiser::JointBilateralFilterSimd(const FrameInfo &frameInfo) {
+    bool halfGuides = m_guidePrecision == Precision::Half;
+    SimdLevel level = std::min(m_simdLevel, DetectSimdLevel());
+    if (halfGuides && level == SimdLevel::AVX2 && !CpuSupportsF16C()) {
+        level = SimdLevel::SSE4; // the AVX2 kernel converts half guides with F16C
+    }
+    JointBilateralSpanFunc filterSpan = GetJointBilateralSpanFunc(level);
+    if (filterSpan == nullptr) {
+        return JointBilateralFilter(frameInfo);
     }
 
+    int height = frameInfo.m_beauty.m_height;
+    int width = frameInfo.m_beauty.m_width;
+    PlanarBuffer2D<float> filteredImage;
+    filteredImage.Copy(frameInfo.m_beauty);
+
+    // Normals of a compact frame are already packed
+    bool compact = frameInfo.IsCompact();
+    PlanarBuffer2D<Half> beautyHalf, normalHalf;
+    if (halfGuides) {
+        beautyHalf = ConvertPlanarBuffer2D<Half>(frameInfo.m_beauty);
+        if (!compact) {
+            normalHalf = ConvertPlanarBuffer2D<Half>(frameInfo.m_normal);
+        }
+    }
+
+    JointBilateralKernelParams params;
+    for (int c = 0; c < 3; c++) {
+        params.beauty[c] = frameInfo.m_beauty.Plane(c);
+        params.normal[c] = frameInfo.m_normal.Plane(c);
+        params.position[c] = frameInfo.m_position.Plane(c);
+        params.output[c] = filteredImage.Plane(c);
+        params.beautyHalf[c] = halfGuides ? reinterpret_cast<const unsigned short *>(
+                                                beautyHalf.Plane(c))
+                                          : nullptr;
+        params.normalHalf[c] = halfGuides ? reinterpret_cast<const unsigned short *>(
+                                                normalHalf.Plane(c))
+                                          : nullptr;
+    }
+    params.normalOct = compact ? frameInfo.m_compact.m_normal.m_buffer.get() : nullptr;
+    params.depth = compact ? frameInfo.m_compact.m_depth.m_buffer.get() : nullptr;
+    const PixelRays &rays = frameInfo.m_compact.m_rays;
+    const Float3 *rayVectors[4] = {&rays.origin, &rays.base, &rays.dx, &rays.dy};
+    for (int i = 0; i < 4; i++) {
+        params.rays[i][0] = rayVectors[i]->x;
+        params.rays[i][1] = rayVectors[i]->y;
+        params.rays[i][2] = rayVectors[i]->z;
+    }
+    params.width = width;
+    params.height = height;
+    params.kernelRadius = m_kernelRadius;
+    params.invSigmaCoord = 1.f / m_sigmaCoord;
+    params.invSigmaColor = 1.f / m_sigmaColor;
+    params.invSigmaNormal = m_sigmaNormal > 0 ? 1.f / m_sigmaNormal : 0.f;
+    params.invSigmaPlane = m_sigmaPlane > 0 ? 1.f / m_sigmaPlane : 0.f;
+
+    auto noReach = [](const int &) { return 0; };
+    RunFilterPasses(frameInfo, 1, noReach, filteredImage,
+                    [&](const int &, const Span &span) {
+                        filterSpan(params, span.y, span.x0, span.x1);
+                    });
+
     return filteredImage;
 }
 
-void Denoiser::Init(const FrameInfo &frameInfo, const Buffer2D<Float3> &filteredColor) {
-    m_accColor.Copy(filteredColor);
-    int height = m_accColor.m_height;
-    int width = m_accColor.m_width;
-    m_misc = CreateBuffer2D<Float3>(width, height);
+template <typename Geometry>
+PlanarBuffer2D<float> Denoiser::ATrousFilter(const FrameInfo &frameInfo,
+                                             const Geometry &geometry) {
+    int height = frameInfo.m_beauty.m_height;
+    int width = frameInfo.m_beauty.m_width;
+
+    // B3-spline taps; pass i samples them 2^i pixels apart, so N passes cover a
+    // radius of 2 * (2^N - 1). Pick the fewest passes that reach m_kernelRadius.
+    const float h[5] = {1.f / 16, 1.f / 4, 3.f / 8, 1.f / 4, 1.f / 16};
+    int passes = 1;
+    while (2 * ((1 << passes) - 1) < m_kernelRadius) {
+        passes++;
+    }
+
+    // Ping-pong between two images, the first pass reads the noisy beauty: pass p
+    // writes dst when p is even and spare when odd, and reads what the pass before
+    // wrote. Pixels left out of the work list (background) keep the noisy color in both.
+    PlanarBuffer2D<float> dst;
+    dst.Copy(frameInfo.m_beauty);
+    PlanarBuffer2D<float> spare;
+    if (passes > 1) {
+        spare.Copy(frameInfo.m_beauty);
+    }
+    PlanarView2D<const float> noisy = frameInfo.m_beauty.View();
+    PlanarView2D<float> images[2] = {dst.View(), spare.View()};
+    const PlanarBuffer2D<float> &result = (passes - 1) % 2 == 0 ? dst : spare;
+
+    // Guides of terms that are off are not read, they need not be loaded
+    bool readNormal = m_sigmaNormal > 0 || m_sigmaPlane > 0;
+    bool readPosition = m_sigmaPlane > 0;
+
+    // Taps of pass p are 2 * 2^p pixels out
+    auto passReach = [](const int &pass) { return 2 << pass; };
+    RunFilterPasses(frameInfo, passes, passReach, result, [&](const int &pass,
+                                                              const Span &span) {
+        int step = 1 << pass;
+        PlanarView2D<const float> in = pass == 0 ? noisy : images[(pass - 1) % 2];
+        PlanarView2D<float> out = images[pass % 2];
+        int y = span.y;
+        for (int x = span.x0; x < span.x1; x++) {
+            Float3 sum_values;
+            float sum_weights = 0.f;
+            Float3 centerColor = in(x, y);
+            Float3 centerNormal = readNormal ? geometry.Normal(x, y) : Float3(0.f);
+            Float3 centerPos = readPosition ? geometry.Position(x, y) : Float3(0.f);
+
+            for (int j = -2; j <= 2; j++) {
+                int l = y + j * step;
+                if (l < 0 || l >= height) continue;
+                for (int i = -2; i <= 2; i++) {
+                    int k = x + i * step;
+                    if (k < 0 || k >= width) continue;
+
+                    // Color edge-stopping uses the image of the current pass,
+                    // the geometric guides always come from the G-Buffer
+                    Float3 tapColor = in(k, l);
+                    float J = JointBilateralWeight(
+                        Sqr(i * step) + Sqr(j * step), centerColor, tapColor,
+                        centerNormal, readNormal ? geometry.Normal(k, l) : Float3(0.f),
+                        centerPos, readPosition ? geometry.Position(k, l) : Float3(0.f));
+                    J *= h[i + 2] * h[j + 2];
+
+                    sum_values += tapColor * J;
+                    sum_weights += J;
+                }
+            }
+
+            if (sum_weights > 0) {
+                sum_values /= sum_weights;
+                out.Set(x, y, sum_values);
+            } else {
+                out.Set(x, y, centerColor);
+            }
+        }
+    });
+
+    return result;
+}
+
+PlanarBuffer2D<float> Denoiser::ATrousFilter(const FrameInfo &frameInfo) {
+    if (frameInfo.IsCompact()) {
+        return ATrousFilter(frameInfo, CompactGeometry(frameInfo.m_compact));
+    }
+    // The color guide is the image of each pass, so only the normals can be half
+    if (m_guidePrecision == Precision::Half) {
+        PlanarBuffer2D<Half> normal = ConvertPlanarBuffer2D<Half>(frameInfo.m_normal);
+        return ATrousFilter(frameInfo,
+                            PlanarGeometry<Half>(normal, frameInfo.m_position));
+    }
+    return ATrousFilter(frameInfo,
+                        PlanarGeometry<float>(frameInfo.m_normal, frameInfo.m_position));
+}
+
+PlanarBuffer2D<float> Denoiser::Filter(const FrameInfo &frameInfo) {
+    switch (m_filterMode) {
+    case FilterMode::ATrous:
+        return ATrousFilter(frameInfo);
+    case FilterMode::JointBilateral:
+    default:
+        if (m_simdLevel != SimdLevel::Scalar) {
+            return JointBilateralFilterSimd(frameInfo);
+        }
+        return JointBilateralFilter(frameInfo);
+    }
+}
+
+void Denoiser::Init(const FrameInfo &frameInfo,
+                    const PlanarBuffer2D<float> &filteredColor) {
+    int height = filteredColor.m_height;
+    int width = filteredColor.m_width;
+    if (m_colorPrecision == Precision::Half) {
+        m_accColorHalf = ConvertPlanarBuffer2D<Half>(filteredColor);
+        m_miscHalf = CreatePlanarBuffer2D<Half>(width, height);
+    } else {
+        m_accColor.Copy(filteredColor);
+        m_misc = CreatePlanarBuffer2D<float>(width, height);
+    }
     m_valid = CreateBuffer2D<bool>(width, height);
+    m_motion = CreatePlanarBuffer2D<float>(width, height);
+}
+
+void CompactFrameInfo(FrameInfo &frameInfo) {
+    if (frameInfo.IsCompact()) {
+        return;
+    }
+    CHECK(frameInfo.m_id.m_width > 0);
+    if (!FitsObjectIds(frameInfo.m_id)) {
+        return;
+    }
+    frameInfo.m_compact = EncodeCompactGBuffer(frameInfo.m_normal, frameInfo.m_position,
+                                               frameInfo.m_id, frameInfo.m_matrix.back());
+    frameInfo.m_normal = PlanarBuffer2D<float>();
+    frameInfo.m_position = PlanarBuffer2D<float>();
+    frameInfo.m_id = Buffer2D<float>();
+}
+
+unsigned Denoiser::RequiredChannels() const {
+    unsigned channels = kFrameBeauty;
+    // The normal term reads normals, the plane term normals and positions
+    if (m_sigmaNormal > 0 || m_sigmaPlane > 0) {
+        channels |= kFrameNormal;
+    }
+    // Positions are loaded even without the plane term: reprojection reads them, and
+    // the IDs, which also mark the background
+    channels |= kFramePosition | kFrameId;
+    return channels;
 }
 
 void Denoiser::Maintain(const FrameInfo &frameInfo) {
-    m_preFrameInfo = frameInfo;
+    TRACE_FRAME_SCOPE("Maintain", m_frameCount);
+    // Reprojection of the next frame only reads its IDs and matrices. Shared ID
+    // planes are never written to, the uint16 copy of full IDs reuses its buffer.
+    // Frames with IDs beyond the uint16 range keep the float plane.
+    m_history.m_matrix = frameInfo.m_matrix;
+    m_history.m_compactFrame = frameInfo.IsCompact();
+    if (frameInfo.IsCompact()) {
+        m_history.m_id = Buffer2D<float>();
+        m_history.m_compactId = frameInfo.m_compact.m_id;
+    } else if (m_compactHistory && FitsObjectIds(frameInfo.m_id)) {
+        m_history.m_id = Buffer2D<float>();
+        if (m_history.m_compactId.m_buffer.use_count() > 1) {
+            m_history.m_compactId = Buffer2D<uint16_t>();
+        }
+        EncodeObjectIds(frameInfo.m_id, m_history.m_compactId);
+    } else {
+        m_history.m_id = frameInfo.m_id;
+        m_history.m_compactId = Buffer2D<uint16_t>();
+    }
 }
 
-Buffer2D<Float3> Denoiser::ProcessFrame(const FrameInfo &frameInfo) {
+PlanarBuffer2D<float> Denoiser::FilterStage(const FrameInfo &frameInfo) {
+    uint64_t heapAllocations = GetThreadBufferHeapAllocations();
+    BuildFilterWork(frameInfo);
+
     // Joint Bilateral Filter the current frame
-    Buffer2D<Float3> filteredColor;
-    filteredColor = Filter(frameInfo);
+    auto start = std::chrono::steady_clock::now();
+    PlanarBuffer2D<float> filteredColor;
+    {
+        TRACE_FRAME_SCOPE("Filter", m_filteredFrameCount);
+        PerfScope perf(m_filterCounts, m_perfCounters && !m_tilePipeline);
+        filteredColor = Filter(frameInfo);
+    }
+    m_filterSeconds += Seconds(start);
+
+    if (++m_filteredFrameCount > 2) {
+        m_steadyHeapAllocations += GetThreadBufferHeapAllocations() - heapAllocations;
+    }
+    return filteredColor;
+}
+
+PlanarBuffer2D<float>
+Denoiser::TemporalStage(const FrameInfo &frameInfo,
+                        const PlanarBuffer2D<float> &filteredColor) {
+    uint64_t heapAllocations = GetThreadBufferHeapAllocations();
+    BuildRowWork(frameInfo);
 
     // Reproject previous frame color to current
+    auto start = std::chrono::steady_clock::now();
     if (m_useTemportal) {
-        Reprojection(frameInfo);
-        TemporalAccumulation(filteredColor);
+        unsigned passes =
+            m_fuseTemporal ? kFusedTemporalPass : kReprojectionPass | kAccumulationPass;
+        TemporalPasses(frameInfo, &filteredColor, passes);
     } else {
+        TRACE_FRAME_SCOPE("Init", m_frameCount);
         Init(frameInfo, filteredColor); // Setup if first frame
     }
+    m_temporalSeconds += Seconds(start);
+
+    return FinishFrame(frameInfo, heapAllocations);
+}
 
+PlanarBuffer2D<float> Denoiser::FinishFrame(const FrameInfo &frameInfo,
+                                            const uint64_t &heapAllocations) {
     // Maintain (ie remember previous frameInfo)
     Maintain(frameInfo);
     if (!m_useTemportal) { // Start temporal accumulation after 1st frame
         m_useTemportal = true;
     }
-    return m_accColor;
+    PlanarBuffer2D<float> result = m_accColor;
+    if (m_colorPrecision == Precision::Half) {
+        TRACE_FRAME_SCOPE("ConvertResult", m_frameCount);
+        result = ConvertPlanarBuffer2D<float>(m_accColorHalf);
+    }
+    // The first frame sets up the history, the second the temporal scratch buffers
+    if (++m_frameCount > 2) {
+        m_steadyHeapAllocations += GetThreadBufferHeapAllocations() - heapAllocations;
+    }
+    return result;
+}
+
+PlanarBuffer2D<float> Denoiser::ProcessFrame(const FrameInfo &frameInfo) {
+    if (!m_useTemportal || !m_tilePipeline) {
+        PlanarBuffer2D<float> filteredColor = FilterStage(frameInfo);
+        return TemporalStage(frameInfo, filteredColor);
+    }
+
+    // On the scheduler the temporal bands run in the task graph of the filter, the
+    // filter time covers both stages
+    uint64_t heapAllocations = GetThreadBufferHeapAllocations();
+    BuildFilterWork(frameInfo);
+    BuildRowWork(frameInfo);
+    auto start = std::chrono::steady_clock::now();
+    {
+        TRACE_FRAME_SCOPE("FrameGraph", m_frameCount);
+        unsigned passes =
+            m_fuseTemporal ? kFusedTemporalPass : kReprojectionPass | kAccumulationPass;
+        TemporalPasses(frameInfo, nullptr, kFilterPass | passes);
+    }
+    m_filterSeconds += Seconds(start);
+    m_filteredFrameCount++;
+    return FinishFrame(frameInfo, heapAllocations);
+}
+
+static const char *PrecisionName(const Precision &precision) {
+    return precision == Precision::Half ? "FP16" : "FP32";
+}
+
+void Denoiser::PrintBufferReport() const {
+    size_t pixels = static_cast<size_t>(m_motion.m_width) * m_motion.m_height;
+    // Format and bytes per pixel of a buffer, against its 32-bit float layout
+    auto print = [&](const char *name, const char *format, const int &size,
+                     const int &fp32Size) {
+        double mib = size * pixels / (1024.0 * 1024.0);
+        double fp32Mib = fp32Size * pixels / (1024.0 * 1024.0);
+        std::cout << "  " << std::left << std::setw(26) << name << std::setw(8) << format
+                  << std::right << std::fixed << std::setprecision(1) << std::setw(9)
+                  << mib << " MiB, saves " << std::setw(7) << fp32Mib - mib << " MiB"
+                  << std::endl;
+    };
+    int colorSize = m_colorPrecision == Precision::Half ? sizeof(Half) : sizeof(float);
+    int guideSize = m_guidePrecision == Precision::Half ? sizeof(Half) : sizeof(float);
+    bool compact = m_history.m_compactFrame;
+
+    std::cout << "Buffers per " << m_motion.m_width << "x" << m_motion.m_height
+              << " frame:" << std::endl;
+    print("accumulated color", PrecisionName(m_colorPrecision), 3 * colorSize, 12);
+    print("accumulation scratch", PrecisionName(m_colorPrecision), 3 * colorSize, 12);
+    print("beauty guide (filter)", PrecisionName(m_guidePrecision), 3 * guideSize, 12);
+    if (compact) {
+        print("normal", "oct16x2", 4, 12);
+        print("position", "depth", 4, 12);
+        print("object ID", "uint16", 2, 4);
+    } else {
+        print("normal guide (filter)", PrecisionName(m_guidePrecision), 3 * guideSize,
+              12);
+        print("position", "FP32", 12, 12);
+        print("object ID", "FP32", 4, 4);
+    }
+    print("depth", "FP32", 4, 4);
+    print("history object ID", m_history.IdBytes() == 2 ? "uint16" : "FP32",
+          m_history.IdBytes(), 4);
+    std::cout << "  G-buffer reads: filter " << FilterBytesPerTap(compact)
+              << " B/tap (FP32 36), reprojection " << ReprojectionBytesPerPixel(compact)
+              << " B/pixel (FP32 20)" << std::endl;
+
+    BufferPoolStats pool = GetBufferPoolStats();
+    std::cout << "  buffer pool: " << pool.heapAllocations << " heap allocations, "
+              << pool.reuses << " reuses, " << std::setprecision(1)
+              << pool.liveBytes / (1024.0 * 1024.0) << " MiB live, "
+              << pool.idleBytes / (1024.0 * 1024.0) << " MiB idle; "
+              << m_steadyHeapAllocations << " heap allocations after frame 2"
+              << std::endl;
+
+    // Time of the stages reading each group of buffers; compare runs with FP32 and
+    // FP16 for the saving
+    if (m_frameCount > 0 && m_tilePipeline) {
+        std::cout << "  filter (" << PrecisionName(m_guidePrecision)
+                  << " guides) and temporal (" << PrecisionName(m_colorPrecision)
+                  << " color), tile pipeline "
+                  << std::setprecision(2)
+                  << 1000.0 * (m_filterSeconds + m_temporalSeconds) / m_frameCount
+                  << " ms/frame" << std::endl;
+    } else if (m_frameCount > 0) {
+        std::cout << "  filter (" << PrecisionName(m_guidePrecision) << " guides) "
+                  << std::setprecision(2) << 1000.0 * m_filterSeconds / m_frameCount
+                  << " ms/frame, temporal (" << PrecisionName(m_colorPrecision)
+                  << " color) " << 1000.0 * m_temporalSeconds / m_frameCount
+                  << " ms/frame" << std::endl;
+    }
+
+    // Per frame: a low IPC with many LLC misses points at memory, a high IPC at compute
+    if (m_perfCounters && m_frameCount > 0) {
+        if (!PerfCountersAvailable()) {
+            std::cout << "  hardware counters unavailable (perf_event_open)" << std::endl;
+            return;
+        }
+        if (m_tilePipeline) {
+            std::cout << "  hardware counters only cover the OpenMP fallback"
+                      << std::endl;
+            return;
+        }
+        auto printCounts = [&](const char *stage, const PerfCounts &counts) {
+            std::cout << "  " << std::left << std::setw(26) << stage << std::right
+                      << std::setprecision(2);
+            for (int i = 0; i < kPerfCounterNum; i++) {
+                PerfCounter counter = static_cast<PerfCounter>(i);
+                std::cout << (i > 0 ? ", " : "");
+                if (counts.Has(counter)) {
+                    std::cout << counts.value[i] / 1e6 / m_frameCount << "M ";
+                } else {
+                    std::cout << "n/a ";
+                }
+                std::cout << PerfCounterName(counter);
+            }
+            if (counts.Has(kPerfCycles) && counts.Has(kPerfInstructions) &&
+                counts.value[kPerfCycles] > 0) {
+                std::cout << ", IPC "
+                          << static_cast<double>(counts.value[kPerfInstructions]) /
+                                 counts.value[kPerfCycles];
+            }
+            std::cout << " per frame" << std::endl;
+        };
+        printCounts("filter", m_filterCounts);
+        if (!m_fuseTemporal) {
+            printCounts("reprojection", m_reprojectionCounts);
+        }
+        printCounts(m_fuseTemporal ? "fused temporal" : "temporal accumulation",
+                    m_accumulationCounts);
+    }
 }
@@ -1,50 +1,334 @@
 #pragma once
 
 #define NOMINMAX
+#include <atomic>
 #include <string>
 
 #include "filesystem/path.h"
 
+#include "util/gbuffer.h"
 #include "util/image.h"
 #include "util/mathutil.h"
+#include "util/perfcounters.h"
+#include "util/simdutil.h"
+#include "util/taskscheduler.h"
+#include "util/tiling.h"
+#include "util/worklist.h"
 
 struct FrameInfo {
   public:
-    Buffer2D<Float3> m_beauty; // noisy, rendered image
+    PlanarBuffer2D<float> m_beauty; // noisy, rendered image
     Buffer2D<float> m_depth; // depth image
-    Buffer2D<Float3> m_normal; // normals
-    Buffer2D<Float3> m_position; // world pos
+    PlanarBuffer2D<float> m_normal; // normals
+    PlanarBuffer2D<float> m_position; // world pos
     Buffer2D<float> m_id; // object ID, -1 for background
     std::vector<Matrix4x4> m_matrix; // object-to-world (model) matrix for each object,
     // followed by world-to-camera (view) matrix and world-to-screen matrix
+    // Normals, IDs and depth for positions in compact form (see CompactFrameInfo).
+    // When present, m_normal, m_position and m_id are empty.
+    CompactGBuffer m_compact;
+
+    bool IsCompact() const { return m_compact.m_id.m_width > 0; }
+    // Object ID of pixel (x, y), -1 for background
+    int ObjectId(const int &x, const int &y) const {
+        if (IsCompact()) {
+            return DecodeObjectId(m_compact.m_id(x, y));
+        }
+        return m_id(x, y);
+    }
+    Float3 Position(const int &x, const int &y) const {
+        if (IsCompact()) {
+            return ReconstructPosition(m_compact.m_rays, x, y, m_compact.m_depth(x, y));
+        }
+        return m_position(x, y);
+    }
+};
+
+// Unchecked IDs and positions of a full or compact frame, for the per-pixel loops of
+// reprojection
+struct FrameView {
+    explicit FrameView(const FrameInfo &frameInfo)
+        : id(frameInfo.m_id, frameInfo.m_compact.m_id),
+          position(frameInfo.m_position.View()), compact(frameInfo.m_compact),
+          isCompact(frameInfo.IsCompact()) {}
+
+    Float3 Position(const int &x, const int &y) const {
+        return isCompact ? compact.Position(x, y) : position(x, y);
+    }
+
+    ObjectIdView id;
+    PlanarView2D<const float> position;
+    CompactGeometry compact;
+    bool isCompact;
+};
+
+// What temporal reuse keeps of the previous frame: the object IDs reprojection
+// compares against and the matrices of the reprojection plan. IDs are held in one
+// of two forms, the other buffer stays empty.
+struct FrameHistory {
+  public:
+    Buffer2D<float> m_id; // object ID, -1 for background
+    Buffer2D<uint16_t> m_compactId; // object ID, kBackgroundId for background
+    std::vector<Matrix4x4> m_matrix; // as FrameInfo::m_matrix
+    bool m_compactFrame = false; // the frame had a compact G-buffer
+
+    // Object ID of pixel (x, y), -1 for background
+    int ObjectId(const int &x, const int &y) const {
+        if (m_compactId.m_width > 0) {
+            return DecodeObjectId(m_compactId(x, y));
+        }
+        return m_id(x, y);
+    }
+    ObjectIdView IdView() const { return ObjectIdView(m_id, m_compactId); }
+    int IdBytes() const {
+        return m_compactId.m_width > 0 ? sizeof(uint16_t) : sizeof(float);
+    }
+};
+
+// Planes of a FrameInfo, to load only those a configuration reads (see
+// Denoiser::RequiredChannels). The matrices always come along.
+enum FrameChannel : unsigned {
+    kFrameBeauty = 1u << 0,
+    kFrameDepth = 1u << 1,
+    kFrameNormal = 1u << 2,
+    kFramePosition = 1u << 3,
+    kFrameId = 1u << 4,
+    kFrameAllChannels = (1u << 5) - 1
+};
+
+// Replace the normal, position and ID planes of a frame by their compact encoding,
+// which cuts the G-buffer bytes the filter and reprojection read by more than half.
+// Needs the IDs; normals and positions that were not loaded stay absent. A frame
+// with object IDs beyond the uint16 range keeps its full planes.
+void CompactFrameInfo(FrameInfo &frameInfo);
+
+// Bands of one temporal pass as tasks of a task graph (Denoiser::m_tilePipeline):
+// band b covers rows [b * bandHeight, (b+1) * bandHeight) and reads the rows the
+// stage before wrote, and the filtered color if readsColor, up to radius rows beyond
+struct TemporalBandStage {
+    static void Run(const void *stage, const int &band) {
+        const TemporalBandStage &s = *static_cast<const TemporalBandStage *>(stage);
+        s.func(s.context, band, s.color);
+    }
+
+    void (*func)(const void *context, const int &band,
+                 const PlanarView2D<const float> &color);
+    const void *context;
+    const char *name;   // trace scope of the OpenMP fallback
+    PerfCounts *counts; // counters of the OpenMP fallback
+    int bandHeight, bandNum, radius;
+    bool readsColor;
+    PlanarView2D<const float> color; // filtered color, set when the graph is built
+};
+
+// Passes of Denoiser::TemporalPasses
+enum TemporalPass : unsigned {
+    kFilterPass = 1,       // the spatial filter of the frame
+    kReprojectionPass = 2, // Reprojection, writes the history into the scratch
+    kAccumulationPass = 4, // TemporalAccumulation, blends that history in place
+    kFusedTemporalPass = 8 // FusedTemporalAccumulation, both in one sweep
+};
+
+enum class FilterMode {
+    JointBilateral, // dense (2r+1)x(2r+1) joint bilateral filter
+    ATrous          // edge-avoiding a-trous wavelet filter (sparse 5x5 passes)
+};
+
+// Storage of a buffer; stages always compute in float
+enum class Precision {
+    Float, // 32-bit float
+    Half   // 16-bit float, half the memory and bandwidth
 };
 
 class Denoiser {
   public:
     Denoiser();
 
-    void Init(const FrameInfo &frameInfo, const Buffer2D<Float3> &filteredColor);
+    void Init(const FrameInfo &frameInfo, const PlanarBuffer2D<float> &filteredColor);
     void Maintain(const FrameInfo &frameInfo);
 
+    void BuildReprojectionPlan(const FrameInfo &frameInfo);
+    template <typename Color>
+    bool ReprojectPixel(const FrameView &frame, const ObjectIdView &preId,
+                        const PlanarView2D<const Color> &accColor, const int &x,
+                        const int &y, Float3 &motion, Float3 &history) const;
+    // The passes of TemporalPass, each leaving the history or the accumulated color
+    // where the next one reads it
     void Reprojection(const FrameInfo &frameInfo);
-    void TemporalAccumulation(const Buffer2D<Float3> &curFilteredColor);
-    Buffer2D<Float3> Filter(const FrameInfo &frameInfo);
+    Float3 ClampAndBlend(const Float3 &X, const Float3 &X_sqr, const float &weight,
+                         const Float3 &preColor, const Float3 &curColor) const;
+    void TemporalAccumulation(const FrameInfo &frameInfo,
+                              const PlanarBuffer2D<float> &curFilteredColor);
+    void FusedTemporalAccumulation(const FrameInfo &frameInfo,
+                                   const PlanarBuffer2D<float> &curFilteredColor);
+    // Run the given TemporalPass passes over curFilteredColor as bands in one task
+    // graph, a band starting once the bands it reads are done, or as one OpenMP loop
+    // per pass without m_tilePipeline. With kFilterPass the bands run in the task
+    // graph of Filter(frameInfo), on its output instead of curFilteredColor.
+    void TemporalPasses(const FrameInfo &frameInfo,
+                        const PlanarBuffer2D<float> *curFilteredColor,
+                        const unsigned &passes);
+    template <typename Color>
+    void TemporalPasses(const FrameInfo &frameInfo,
+                        const PlanarBuffer2D<float> *curFilteredColor,
+                        const unsigned &passes, PlanarBuffer2D<Color> &accColor,
+                        PlanarBuffer2D<Color> &misc);
+    // Band b of Reprojection: the history of its rows from accColor into history
+    template <typename Color>
+    void ReprojectionBand(const FrameView &frame, const PlanarBuffer2D<Color> &accColor,
+                          PlanarBuffer2D<Color> &history, const int &band);
+    // Band b of TemporalAccumulation, blending the history in out in place, or with
+    // frame of FusedTemporalAccumulation, reprojecting accColor into out on the fly
+    template <typename Color>
+    void AccumulationBand(const FrameView *frame,
+                          const PlanarView2D<const float> &curColor,
+                          const PlanarBuffer2D<Color> &accColor,
+                          PlanarBuffer2D<Color> &out, const int &band);
+    // Run the bands of stages, after the stage before them and on color
+    void RunBandStages(std::vector<TemporalBandStage> &stages,
+                       const PlanarView2D<const float> &color);
+    PlanarBuffer2D<float> Filter(const FrameInfo &frameInfo);
+    // Run filterSpan(pass, span) over m_filterWork for passNum passes, where a pass
+    // reads the output of the one before up to passRadius(pass) pixels away and the
+    // last one writes output (which m_filterBandStages read)
+    template <typename PassRadius, typename FilterSpan>
+    void RunFilterPasses(const FrameInfo &frameInfo, const int &passNum,
+                         const PassRadius &passRadius,
+                         const PlanarBuffer2D<float> &output,
+                         const FilterSpan &filterSpan);
+    PlanarBuffer2D<float> JointBilateralFilter(const FrameInfo &frameInfo);
+    template <typename Guide, typename Geometry>
+    PlanarBuffer2D<float> JointBilateralFilter(const FrameInfo &frameInfo,
+                                               const PlanarBuffer2D<Guide> &beauty,
+                                               const Geometry &geometry);
+    PlanarBuffer2D<float> JointBilateralFilterSimd(const FrameInfo &frameInfo);
+    PlanarBuffer2D<float> ATrousFilter(const FrameInfo &frameInfo);
+    template <typename Geometry>
+    PlanarBuffer2D<float> ATrousFilter(const FrameInfo &frameInfo,
+                                       const Geometry &geometry);
+    // G-buffer bytes the joint bilateral filter reads per tap, and reprojection per
+    // pixel, with full or compact frames
+    int FilterBytesPerTap(const bool &compact) const;
+    int ReprojectionBytesPerPixel(const bool &compact) const;
+    int FilterTileSize(const bool &compact) const;
+    void FilterTiles(const int &width, const int &height, const bool &compact,
+                     std::vector<Tile> &tiles) const;
+    // Work lists of the filter and of the temporal passes; the filter stage only
+    // touches the first, the temporal stage the second
+    void BuildFilterWork(const FrameInfo &frameInfo);
+    void BuildRowWork(const FrameInfo &frameInfo);
+    float JointBilateralWeight(const float &sqrPixelDist, const Float3 &centerColor,
+                               const Float3 &tapColor, const Float3 &centerNormal,
+                               const Float3 &tapNormal, const Float3 &centerPos,
+                               const Float3 &tapPos) const;
 
-    Buffer2D<Float3> ProcessFrame(const FrameInfo &frameInfo);
+    // Channels ProcessFrame reads with the current settings; the others need not be
+    // loaded. Depth is never read.
+    unsigned RequiredChannels() const;
+
+    // Denoise the next frame: TemporalStage(frameInfo, FilterStage(frameInfo)), or
+    // both in one task graph with m_tilePipeline
+    PlanarBuffer2D<float> ProcessFrame(const FrameInfo &frameInfo);
+    // The spatial filter reads nothing the temporal stages write, so FilterStage may
+    // run for a later frame while TemporalStage runs for an earlier one (see
+    // FramePipeline). Calls of one stage must not overlap, and TemporalStage takes the
+    // frames in order.
+    PlanarBuffer2D<float> FilterStage(const FrameInfo &frameInfo);
+    PlanarBuffer2D<float> TemporalStage(const FrameInfo &frameInfo,
+                                        const PlanarBuffer2D<float> &filteredColor);
+    // Remember the frame for the next one and return the accumulated color
+    PlanarBuffer2D<float> FinishFrame(const FrameInfo &frameInfo,
+                                      const uint64_t &heapAllocations);
+    // Precision, size and FP32 saving of every buffer, and the time of the stages
+    // reading them, averaged over the frames so far
+    void PrintBufferReport() const;
 
   public:
-    FrameInfo m_preFrameInfo; // previous frame's G-Buffer Info
-    Buffer2D<Float3> m_accColor; // accumulated color
-    Buffer2D<Float3> m_misc; // temporary array to swap with m_accColor
+    FrameHistory m_history; // previous frame's IDs and matrices
+    // Keep the previous frame's IDs as uint16 even for full frames, half the bytes
+    // of the float plane, unless one of them does not fit. Compact frames always
+    // share their uint16 IDs.
+    bool m_compactHistory = true;
+    PlanarBuffer2D<float> m_accColor; // accumulated color
+    PlanarBuffer2D<float> m_misc; // temporary array to swap with m_accColor
+    // Storage of the accumulated color. With Half it lives in m_accColorHalf and
+    // m_miscHalf instead, and m_accColor / m_misc stay empty. Set before the first frame.
+    Precision m_colorPrecision = Precision::Float;
+    PlanarBuffer2D<Half> m_accColorHalf;
+    PlanarBuffer2D<Half> m_miscHalf;
+    // Storage of the beauty and normal guides the spatial filters read, converted
+    // once per frame. Position and depth always stay float for the plane and
+    // reprojection terms.
+    Precision m_guidePrecision = Precision::Float;
     Buffer2D<bool> m_valid; // is the back-projected pixel on the previous frame valid?
+    // Per object ID, current world position to previous frame's screen position
+    std::vector<Matrix4x4> m_reprojectionPlan;
+    // Screen-space motion to the previous frame (x, y) and history validity (z, 0 or
+    // 1), written by Reprojection
+    PlanarBuffer2D<float> m_motion;
     bool m_useTemportal;
+    // Reproject, validate and blend the history in one banded sweep instead of
+    // separate Reprojection and TemporalAccumulation passes (m_valid is not written)
+    bool m_fuseTemporal = false;
+    // Run the spatial filter as a graph of tile tasks and the temporal passes as
+    // bands on the work-stealing scheduler. A tile of a pass starts once the tiles
+    // of the pass before around it are done, and a temporal band once the filtered
+    // tiles and the bands of the pass before around it are, with no barrier between
+    // passes or stages. Whole-row tiles (m_tileSize 0) give way to L2-sized ones.
+    // false falls back to one OpenMP parallel loop per pass.
+    bool m_tilePipeline = true;
+    // Bands the next RunBandStages runs, and those the next Filter runs in its graph
+    std::vector<TemporalBandStage> m_bandStages;
+    std::vector<TemporalBandStage> m_filterBandStages;
+    // Rebuilt every frame by RunFilterPasses and RunBandStages, which may run at once
+    TaskGraph m_filterGraph;
+    TaskGraph m_temporalGraph;
 
     float m_alpha = 0.2f; // accumulation weight
     float m_colorBoxK = 1.0f;
+    int m_clampRadius = 3; // neighbourhood of the color clamp is (2r+1)x(2r+1)
+
+    FilterMode m_filterMode = FilterMode::JointBilateral;
+    int m_kernelRadius = 16; // footprint of the spatial filter, in pixels
+    // Instruction set of the joint bilateral filter, capped to what the CPU supports.
+    // SimdLevel::Scalar selects the reference implementation.
+    SimdLevel m_simdLevel;
+    // Edge of the square tiles the spatial filter works on, so that a tile and its
+    // m_kernelRadius halo stay in L2. 0 walks whole rows, negative picks the size
+    // from the L2 cache size.
+    int m_tileSize = 0;
+    // Pixels every pass visits this frame, rebuilt by BuildWorkLists from the ID
+    // buffer: spans of the filter tiles, and the same pixels in row order for the
+    // temporal passes
+    WorkList m_filterWork;
+    WorkList m_rowWork;
+    std::vector<Tile> m_filterTiles; // tiles of m_filterWork and m_rowWork
+    std::vector<Tile> m_rowTiles;
+    // Leave background pixels (ID < 0) out of the work lists. They keep the noisy
+    // color through the filter and get no history.
+    bool m_skipBackground = true;
 
-    // Sigmas for JBF (needs tuning for different scenes)
+    // Sigmas for JBF (needs tuning for different scenes). A normal or plane sigma of 0
+    // turns that term off.
     float m_sigmaPlane = 0.1f;
     float m_sigmaColor = 0.6f;
     float m_sigmaNormal = 0.1f;
     float m_sigmaCoord = 32.0f;
+
+    // Accumulated stage times for PrintBufferReport
+    double m_filterSeconds = 0.0;
+    double m_temporalSeconds = 0.0;
+    // Sample hardware counters around every stage for PrintBufferReport, at the cost of
+    // an OpenMP region per stage boundary. The fused temporal pass is counted as
+    // accumulation; only the OpenMP fallback is counted, the scheduler's threads are
+    // not.
+    bool m_perfCounters = false;
+    PerfCounts m_filterCounts;
+    PerfCounts m_reprojectionCounts;
+    PerfCounts m_accumulationCounts;
+    int m_frameCount = 0;
+    int m_filteredFrameCount = 0;
+    // Buffer pool heap allocations of both stages past the first two frames, 0 for a
+    // fixed-resolution sequence once the pool has warmed up
+    std::atomic<uint64_t> m_steadyHeapAllocations{0};
 };
\ No newline at end of file
@@ -0,0 +1,19 @@
+#include "filterkernel.h"
+
+JointBilateralSpanFunc GetJointBilateralSpanFunc(const SimdLevel &level) {
+#if SIMD_X86
+    switch (level) {
+    case SimdLevel::AVX512:
+        return JointBilateralSpanAVX512;
+    case SimdLevel::AVX2:
+        return JointBilateralSpanAVX2;
+    case SimdLevel::SSE4:
+        return JointBilateralSpanSSE4;
+    case SimdLevel::Scalar:
+    default:
+        return nullptr;
+    }
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "util/simdutil.h"
+
+// Raw-pointer interface of the vectorized joint bilateral filter.
+//
+// The per-ISA translation units (filterkernel_*.cpp) are compiled with -mavx2,
+// -mavx512f, ... and only ever include this header and filterkernel_impl.h. Pulling
+// in Buffer2D/Float3 there would let the linker pick an AVX-encoded copy of some
+// inline function for the scalar code as well.
+//
+// Results match Denoiser::JointBilateralFilter (the scalar reference) to within a
+// relative error of 1e-4 per channel: exp and acos are replaced by polynomial
+// approximations (~1e-7 and ~2e-8 error) and divisions by the sigmas by
+// multiplications with their reciprocals.
+
+struct JointBilateralKernelParams {
+    // One width * height plane per channel
+    const float *beauty[3];
+    const float *normal[3];
+    const float *position[3];
+    float *output[3];
+    // Half (binary16) copies of the beauty and normal guides. When set, the taps and
+    // the center are read from these instead, and beauty is only used for pixels
+    // without any weight.
+    const unsigned short *beautyHalf[3];
+    const unsigned short *normalHalf[3];
+    // Compact G-buffer (util/gbuffer.h). When normalOct or depth is set, normals are
+    // decoded from normalOct and positions rebuilt from depth and the pixel rays
+    // (origin, base, dx, dy), instead of being read from normal(Half) and position.
+    const unsigned int *normalOct;
+    const float *depth;
+    float rays[4][3];
+    int width, height;
+    int kernelRadius;
+    // invSigmaNormal / invSigmaPlane of 0 turn their term off; the normals are then
+    // only read for the plane term and the positions not at all
+    float invSigmaCoord, invSigmaColor, invSigmaNormal, invSigmaPlane;
+};
+
+// Filter output pixels [x0, x1) of row y, evaluating 4/8/16 neighbour taps per
+// instruction. The AVX2 kernel needs F16C for half guides.
+typedef void (*JointBilateralSpanFunc)(const JointBilateralKernelParams &params,
+                                       const int &y, const int &x0, const int &x1);
+
+void JointBilateralSpanSSE4(const JointBilateralKernelParams &params, const int &y,
+                            const int &x0, const int &x1);
+void JointBilateralSpanAVX2(const JointBilateralKernelParams &params, const int &y,
+                            const int &x0, const int &x1);
+void JointBilateralSpanAVX512(const JointBilateralKernelParams &params, const int &y,
+                              const int &x0, const int &x1);
+
+// Span kernel for the given level, nullptr for SimdLevel::Scalar or if the kernels
+// were not built for this architecture
+JointBilateralSpanFunc GetJointBilateralSpanFunc(const SimdLevel &level);
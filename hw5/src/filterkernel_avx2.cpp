@@ -0,0 +1,100 @@
+#include "util/simdutil.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+
+#include "filterkernel_impl.h"
+
+namespace {
+
+struct VecAVX2 {
+    typedef __m256 Reg;
+    typedef __m256 Mask;
+    static const int Width = 8;
+
+    static Reg Zero() { return _mm256_setzero_ps(); }
+    static Reg Set1(const float &v) { return _mm256_set1_ps(v); }
+    static Reg Iota() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+    // Lanes at or past count are zero and never touch memory
+    static Reg Load(const float *p, const int &count) {
+        if (count == Width) {
+            return _mm256_loadu_ps(p);
+        }
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count),
+                                          _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        return _mm256_maskload_ps(p, mask);
+    }
+    // Lanes at or past count are zero
+    static Reg LoadHalf(const unsigned short *p, const int &count) {
+        if (count == Width) {
+            return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        }
+        unsigned short v[Width] = {};
+        for (int i = 0; i < count; i++) {
+            v[i] = p[i];
+        }
+        return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v)));
+    }
+    // Low and high signed 16 bits of each 32-bit value, as floats; lanes at or past
+    // count are zero and never touch memory
+    static void LoadInt16Pairs(const unsigned int *p, const int &count, Reg &lo,
+                               Reg &hi) {
+        const int *ip = reinterpret_cast<const int *>(p);
+        __m256i x;
+        if (count == Width) {
+            x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ip));
+        } else {
+            __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count),
+                                              _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            x = _mm256_maskload_epi32(ip, mask);
+        }
+        lo = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16));
+        hi = _mm256_cvtepi32_ps(_mm256_srai_epi32(x, 16));
+    }
+    static Reg Add(const Reg &a, const Reg &b) { return _mm256_add_ps(a, b); }
+    static Reg Sub(const Reg &a, const Reg &b) { return _mm256_sub_ps(a, b); }
+    static Reg Mul(const Reg &a, const Reg &b) { return _mm256_mul_ps(a, b); }
+    static Reg Div(const Reg &a, const Reg &b) { return _mm256_div_ps(a, b); }
+    static Reg Fmadd(const Reg &a, const Reg &b, const Reg &c) {
+        return _mm256_fmadd_ps(a, b, c);
+    }
+    static Reg Min(const Reg &a, const Reg &b) { return _mm256_min_ps(a, b); }
+    static Reg Max(const Reg &a, const Reg &b) { return _mm256_max_ps(a, b); }
+    static Reg Abs(const Reg &a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+    // Magnitude of mag with the sign of sign
+    static Reg CopySign(const Reg &mag, const Reg &sign) {
+        __m256 signBit = _mm256_set1_ps(-0.f);
+        return _mm256_or_ps(_mm256_andnot_ps(signBit, mag), _mm256_and_ps(signBit, sign));
+    }
+    static Reg Sqrt(const Reg &a) { return _mm256_sqrt_ps(a); }
+    static Reg Round(const Reg &a) {
+        return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+    // 2^n for integral n in [-126, 127]
+    static Reg Pow2(const Reg &n) {
+        __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+    }
+    static Mask GreaterThanZero(const Reg &a) {
+        return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GT_OQ);
+    }
+    static Mask FirstLanes(const int &count) {
+        return _mm256_cmp_ps(Iota(), _mm256_set1_ps(float(count)), _CMP_LT_OQ);
+    }
+    static Reg ZeroUnless(const Mask &m, const Reg &a) { return _mm256_and_ps(m, a); }
+    static float HSum(const Reg &a) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+} // namespace
+
+void JointBilateralSpanAVX2(const JointBilateralKernelParams &params, const int &y,
+                            const int &x0, const int &x1) {
+    JointBilateralSpan<VecAVX2>(params, y, x0, x1);
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "util/simdutil.h"
+
+#if SIMD_X86
+// GCC 12's AVX-512 headers set their undefined registers from themselves (__Y = __Y),
+// which -Wmaybe-uninitialized reports wherever such an intrinsic is inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+
+#include "filterkernel_impl.h"
+
+namespace {
+
+struct VecAVX512 {
+    typedef __m512 Reg;
+    typedef __mmask16 Mask;
+    static const int Width = 16;
+
+    static Reg Zero() { return _mm512_setzero_ps(); }
+    static Reg Set1(const float &v) { return _mm512_set1_ps(v); }
+    static Reg Iota() {
+        return _mm512_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f,
+                              11.f, 12.f, 13.f, 14.f, 15.f);
+    }
+    // Lanes at or past count are zero and never touch memory
+    static Reg Load(const float *p, const int &count) {
+        return _mm512_maskz_loadu_ps(FirstLanes(count), p);
+    }
+    // Lanes at or past count are zero
+    static Reg LoadHalf(const unsigned short *p, const int &count) {
+        if (count == Width) {
+            return _mm512_cvtph_ps(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+        }
+        unsigned short v[Width] = {};
+        for (int i = 0; i < count; i++) {
+            v[i] = p[i];
+        }
+        return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(v)));
+    }
+    // Low and high signed 16 bits of each 32-bit value, as floats; lanes at or past
+    // count are zero and never touch memory
+    static void LoadInt16Pairs(const unsigned int *p, const int &count, Reg &lo,
+                               Reg &hi) {
+        __m512i x = _mm512_maskz_loadu_epi32(FirstLanes(count), p);
+        lo = _mm512_cvtepi32_ps(_mm512_srai_epi32(_mm512_slli_epi32(x, 16), 16));
+        hi = _mm512_cvtepi32_ps(_mm512_srai_epi32(x, 16));
+    }
+    static Reg Add(const Reg &a, const Reg &b) { return _mm512_add_ps(a, b); }
+    static Reg Sub(const Reg &a, const Reg &b) { return _mm512_sub_ps(a, b); }
+    static Reg Mul(const Reg &a, const Reg &b) { return _mm512_mul_ps(a, b); }
+    static Reg Div(const Reg &a, const Reg &b) { return _mm512_div_ps(a, b); }
+    static Reg Fmadd(const Reg &a, const Reg &b, const Reg &c) {
+        return _mm512_fmadd_ps(a, b, c);
+    }
+    static Reg Min(const Reg &a, const Reg &b) { return _mm512_min_ps(a, b); }
+    static Reg Max(const Reg &a, const Reg &b) { return _mm512_max_ps(a, b); }
+    static Reg Abs(const Reg &a) { return _mm512_abs_ps(a); }
+    // Magnitude of mag with the sign of sign (integer ops, float and/or need DQ)
+    static Reg CopySign(const Reg &mag, const Reg &sign) {
+        __m512i signBit = _mm512_set1_epi32(static_cast<int>(0x80000000u));
+        return _mm512_castsi512_ps(
+            _mm512_or_si512(_mm512_andnot_si512(signBit, _mm512_castps_si512(mag)),
+                            _mm512_and_si512(signBit, _mm512_castps_si512(sign))));
+    }
+    static Reg Sqrt(const Reg &a) { return _mm512_sqrt_ps(a); }
+    static Reg Round(const Reg &a) {
+        return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+    // 2^n for integral n in [-126, 127]
+    static Reg Pow2(const Reg &n) {
+        __m512i e = _mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+    }
+    static Mask GreaterThanZero(const Reg &a) {
+        return _mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_GT_OQ);
+    }
+    static Mask FirstLanes(const int &count) {
+        return (Mask)((1u << count) - 1u);
+    }
+    static Reg ZeroUnless(const Mask &m, const Reg &a) {
+        return _mm512_maskz_mov_ps(m, a);
+    }
+    static float HSum(const Reg &a) { return _mm512_reduce_add_ps(a); }
+};
+
+} // namespace
+
+void JointBilateralSpanAVX512(const JointBilateralKernelParams &params, const int &y,
+                              const int &x0, const int &x1) {
+    JointBilateralSpan<VecAVX512>(params, y, x0, x1);
+}
+
+#endif
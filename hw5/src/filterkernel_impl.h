@@ -0,0 +1,261 @@
+#pragma once
+
+// ISA-independent body of the vectorized joint bilateral filter. Included by each
+// filterkernel_*.cpp after it has defined its vector type V, which provides:
+//   Reg, Mask, Width, Zero, Set1, Iota, Load, LoadHalf, LoadInt16Pairs, Add, Sub,
+//   Mul, Div, Fmadd, Min, Max, Abs, CopySign, Sqrt, Round, Pow2, GreaterThanZero,
+//   FirstLanes, ZeroUnless, HSum
+//
+// Everything here has internal linkage, so the instantiations of different
+// translation units never get merged.
+
+#include "filterkernel.h"
+
+namespace {
+
+// exp(x) after Cephes' expf: range reduction to [-ln2/2, ln2/2] and a degree 6
+// polynomial, relative error ~1e-7. Inputs below -87.3 return ~1e-38.
+template <typename V>
+inline typename V::Reg ExpApprox(typename V::Reg x) {
+    typedef typename V::Reg R;
+    x = V::Min(V::Max(x, V::Set1(-87.3365f)), V::Set1(88.3762f));
+    R n = V::Round(V::Mul(x, V::Set1(1.44269504088896341f)));
+    R r = V::Fmadd(n, V::Set1(-0.693359375f), x);
+    r = V::Fmadd(n, V::Set1(2.12194440e-4f), r);
+
+    R p = V::Set1(1.9875691500e-4f);
+    p = V::Fmadd(p, r, V::Set1(1.3981999507e-3f));
+    p = V::Fmadd(p, r, V::Set1(8.3334519073e-3f));
+    p = V::Fmadd(p, r, V::Set1(4.1665795894e-2f));
+    p = V::Fmadd(p, r, V::Set1(1.6666665459e-1f));
+    p = V::Fmadd(p, r, V::Set1(5.0000001201e-1f));
+    p = V::Fmadd(p, V::Mul(r, r), V::Add(r, V::Set1(1.f)));
+    return V::Mul(p, V::Pow2(n));
+}
+
+// acos(x) for x in [0, 1] (Abramowitz & Stegun 4.4.46), absolute error ~2e-8
+template <typename V>
+inline typename V::Reg AcosApprox01(typename V::Reg x) {
+    typedef typename V::Reg R;
+    R p = V::Set1(-0.0012624911f);
+    p = V::Fmadd(p, x, V::Set1(0.0066700901f));
+    p = V::Fmadd(p, x, V::Set1(-0.0170881256f));
+    p = V::Fmadd(p, x, V::Set1(0.0308918810f));
+    p = V::Fmadd(p, x, V::Set1(-0.0501743046f));
+    p = V::Fmadd(p, x, V::Set1(0.0889789874f));
+    p = V::Fmadd(p, x, V::Set1(-0.2145988016f));
+    p = V::Fmadd(p, x, V::Set1(1.5707963050f));
+    return V::Mul(p, V::Sqrt(V::Sub(V::Set1(1.f), x)));
+}
+
+template <typename V>
+inline typename V::Reg Dot3(const typename V::Reg a[3], const typename V::Reg b[3]) {
+    return V::Fmadd(a[2], b[2], V::Fmadd(a[1], b[1], V::Mul(a[0], b[0])));
+}
+
+// count guide values at offset, from the half planes if HalfGuides
+template <typename V, bool HalfGuides>
+inline typename V::Reg LoadGuide(const float *plane, const unsigned short *halfPlane,
+                                 const int &offset, const int &count) {
+    return HalfGuides ? V::LoadHalf(halfPlane + offset, count)
+                      : V::Load(plane + offset, count);
+}
+
+// count octahedral normals at p, as util/gbuffer.h's DecodeOctahedral
+template <typename V>
+inline void LoadOctahedral(const unsigned int *p, const int &count,
+                           typename V::Reg n[3]) {
+    typedef typename V::Reg R;
+    R u, v;
+    V::LoadInt16Pairs(p, count, u, v);
+    // -32768 only occurs in kZeroNormal
+    typename V::Mask nonZero = V::GreaterThanZero(V::Add(u, V::Set1(32767.5f)));
+    u = V::Mul(u, V::Set1(1.f / 32767.f));
+    v = V::Mul(v, V::Set1(1.f / 32767.f));
+    R z = V::Sub(V::Sub(V::Set1(1.f), V::Abs(u)), V::Abs(v));
+    R t = V::Max(V::Sub(V::Zero(), z), V::Zero());
+    u = V::Sub(u, V::CopySign(t, u));
+    v = V::Sub(v, V::CopySign(t, v));
+    R inv = V::Div(V::Set1(1.f), V::Sqrt(V::Fmadd(z, z, V::Fmadd(v, v, V::Mul(u, u)))));
+    n[0] = V::ZeroUnless(nonZero, V::Mul(u, inv));
+    n[1] = V::ZeroUnless(nonZero, V::Mul(v, inv));
+    n[2] = V::ZeroUnless(nonZero, V::Mul(z, inv));
+}
+
+// World positions of pixels (sx - 0.5, sy - 0.5) at depth, as util/gbuffer.h's
+// ReconstructPosition
+template <typename V>
+inline void ReconstructPositions(const float (&rays)[4][3], const typename V::Reg &sx,
+                                 const typename V::Reg &sy, const typename V::Reg &depth,
+                                 typename V::Reg position[3]) {
+    for (int c = 0; c < 3; c++) {
+        typename V::Reg ray =
+            V::Fmadd(V::Set1(rays[3][c]), sy,
+                     V::Fmadd(V::Set1(rays[2][c]), sx, V::Set1(rays[1][c])));
+        position[c] = V::Fmadd(ray, depth, V::Set1(rays[0][c]));
+    }
+}
+
+// Value of the first lane
+template <typename V>
+inline float FirstLane(const typename V::Reg &a) {
+    return V::HSum(V::ZeroUnless(V::FirstLanes(1), a));
+}
+
+template <typename V, bool HalfGuides, bool Compact>
+inline void JointBilateralSpanImpl(const JointBilateralKernelParams &p, const int &y,
+                                   const int &x0, const int &x1) {
+    typedef typename V::Reg R;
+    const int W = V::Width;
+    const int r = p.kernelRadius;
+    const int lmin = y - r > 0 ? y - r : 0;
+    const int lmax = y + r + 1 < p.height ? y + r + 1 : p.height;
+    const R invSigmaCoord = V::Set1(p.invSigmaCoord);
+    const R invSigmaColor = V::Set1(p.invSigmaColor);
+    const R invSigmaNormal = V::Set1(p.invSigmaNormal);
+    const R invSigmaPlane = V::Set1(p.invSigmaPlane);
+    const R zero = V::Zero();
+    const R one = V::Set1(1.f);
+    const R minusHalf = V::Set1(-0.5f);
+    // Terms with a zero inverse sigma are off, their guides are not read
+    const bool normalTerm = p.invSigmaNormal > 0.f;
+    const bool planeTerm = p.invSigmaPlane > 0.f;
+    const bool readNormal = normalTerm || planeTerm;
+
+    for (int x = x0; x < x1; x++) {
+        const int kmin = x - r > 0 ? x - r : 0;
+        const int kmax = x + r + 1 < p.width ? x + r + 1 : p.width;
+        const int center = y * p.width + x;
+
+        R cb[3], cn[3] = {zero, zero, zero}, cp[3] = {zero, zero, zero};
+        if (Compact) {
+            R sx = V::Set1(x + 0.5f), sy = V::Set1(y + 0.5f);
+            if (readNormal) {
+                LoadOctahedral<V>(p.normalOct + center, 1, cn);
+            }
+            if (planeTerm) {
+                ReconstructPositions<V>(p.rays, sx, sy, V::Load(p.depth + center, 1), cp);
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            if (HalfGuides) {
+                cb[c] = V::Set1(FirstLane<V>(V::LoadHalf(p.beautyHalf[c] + center, 1)));
+            } else {
+                cb[c] = V::Set1(p.beauty[c][center]);
+            }
+            if (Compact) {
+                cn[c] = V::Set1(FirstLane<V>(cn[c]));
+                cp[c] = V::Set1(FirstLane<V>(cp[c]));
+                continue;
+            }
+            if (readNormal && HalfGuides) {
+                cn[c] = V::Set1(FirstLane<V>(V::LoadHalf(p.normalHalf[c] + center, 1)));
+            } else if (readNormal) {
+                cn[c] = V::Set1(p.normal[c][center]);
+            }
+            if (planeTerm) {
+                cp[c] = V::Set1(p.position[c][center]);
+            }
+        }
+
+        R sum[3] = {zero, zero, zero};
+        R sumWeights = zero;
+        for (int l = lmin; l < lmax; l++) {
+            const R dy2 = V::Set1(float((l - y) * (l - y)));
+            const R sy = V::Set1(l + 0.5f);
+            for (int k0 = kmin; k0 < kmax; k0 += W) {
+                const int count = kmax - k0 < W ? kmax - k0 : W;
+                const int tap = l * p.width + k0;
+
+                // Guides of terms that are off stay zero, not uninitialized
+                R tb[3], tn[3] = {zero, zero, zero}, tp[3] = {zero, zero, zero};
+                for (int c = 0; c < 3; c++) {
+                    tb[c] = LoadGuide<V, HalfGuides>(p.beauty[c], p.beautyHalf[c], tap,
+                                                     count);
+                }
+                if (Compact) {
+                    R sx = V::Add(V::Iota(), V::Set1(k0 + 0.5f));
+                    if (readNormal) {
+                        LoadOctahedral<V>(p.normalOct + tap, count, tn);
+                    }
+                    if (planeTerm) {
+                        ReconstructPositions<V>(p.rays, sx, sy,
+                                                V::Load(p.depth + tap, count), tp);
+                    }
+                } else {
+                    for (int c = 0; c < 3; c++) {
+                        if (readNormal) {
+                            tn[c] = LoadGuide<V, HalfGuides>(p.normal[c], p.normalHalf[c],
+                                                             tap, count);
+                        }
+                        if (planeTerm) {
+                            tp[c] = V::Load(p.position[c] + tap, count);
+                        }
+                    }
+                }
+
+                // Coordinate difference
+                R dx = V::Add(V::Iota(), V::Set1(float(k0 - x)));
+                R J = V::Mul(V::Fmadd(dx, dx, dy2), invSigmaCoord);
+
+                // Color difference
+                R db[3] = {V::Sub(cb[0], tb[0]), V::Sub(cb[1], tb[1]),
+                           V::Sub(cb[2], tb[2])};
+                J = V::Fmadd(Dot3<V>(db, db), invSigmaColor, J);
+
+                // Normal difference
+                if (normalTerm) {
+                    R cosine = V::Min(V::Max(Dot3<V>(cn, tn), zero), one);
+                    R angle = AcosApprox01<V>(cosine);
+                    J = V::Fmadd(V::Mul(angle, angle), invSigmaNormal, J);
+                }
+
+                // Plane difference, (n . d)^2 / |d|^2 and 0 for coincident points
+                if (planeTerm) {
+                    R d[3] = {V::Sub(tp[0], cp[0]), V::Sub(tp[1], cp[1]),
+                              V::Sub(tp[2], cp[2])};
+                    R sqrLength = Dot3<V>(d, d);
+                    R plane = Dot3<V>(cn, d);
+                    plane = V::ZeroUnless(V::GreaterThanZero(sqrLength),
+                                          V::Div(V::Mul(plane, plane), sqrLength));
+                    J = V::Fmadd(plane, invSigmaPlane, J);
+                }
+
+                R weight = ExpApprox<V>(V::Mul(J, minusHalf));
+                weight = V::ZeroUnless(V::FirstLanes(count), weight);
+
+                for (int c = 0; c < 3; c++) {
+                    sum[c] = V::Fmadd(tb[c], weight, sum[c]);
+                }
+                sumWeights = V::Add(sumWeights, weight);
+            }
+        }
+
+        float sumWeight = V::HSum(sumWeights);
+        if (sumWeight > 0) {
+            float inv = 1.f / sumWeight;
+            for (int c = 0; c < 3; c++) {
+                p.output[c][center] = V::HSum(sum[c]) * inv;
+            }
+        } else {
+            for (int c = 0; c < 3; c++) {
+                p.output[c][center] = p.beauty[c][center];
+            }
+        }
+    }
+}
+
+template <typename V>
+inline void JointBilateralSpan(const JointBilateralKernelParams &p, const int &y,
+                               const int &x0, const int &x1) {
+    bool half = p.beautyHalf[0] != nullptr;
+    if (p.normalOct != nullptr || p.depth != nullptr) {
+        half ? JointBilateralSpanImpl<V, true, true>(p, y, x0, x1)
+             : JointBilateralSpanImpl<V, false, true>(p, y, x0, x1);
+    } else {
+        half ? JointBilateralSpanImpl<V, true, false>(p, y, x0, x1)
+             : JointBilateralSpanImpl<V, false, false>(p, y, x0, x1);
+    }
+}
+
+} // namespace
@@ -0,0 +1,105 @@
+#include "util/simdutil.h"
+
+#if SIMD_X86
+#include <smmintrin.h>
+
+#include "filterkernel_impl.h"
+
+namespace {
+
+struct VecSSE4 {
+    typedef __m128 Reg;
+    typedef __m128 Mask;
+    static const int Width = 4;
+
+    static Reg Zero() { return _mm_setzero_ps(); }
+    static Reg Set1(const float &v) { return _mm_set1_ps(v); }
+    static Reg Iota() { return _mm_setr_ps(0.f, 1.f, 2.f, 3.f); }
+    // Lanes at or past count are zero
+    static Reg Load(const float *p, const int &count) {
+        if (count == Width) {
+            return _mm_loadu_ps(p);
+        }
+        float v[Width] = {0.f, 0.f, 0.f, 0.f};
+        for (int i = 0; i < count; i++) {
+            v[i] = p[i];
+        }
+        return _mm_loadu_ps(v);
+    }
+    // Half to float with SSE2 integer ops (no F16C here), F. Giesen's
+    // half_to_float_SSE2; lanes at or past count are zero
+    static Reg LoadHalf(const unsigned short *p, const int &count) {
+        unsigned short v[Width] = {0, 0, 0, 0};
+        for (int i = 0; i < count; i++) {
+            v[i] = p[i];
+        }
+        __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(v));
+        h = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+        __m128i expMant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+        __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMant), 16);
+        // Rebias the exponent by multiplying with 2^112, which also normalizes denormals
+        __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)),
+                                   _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+        __m128i infNan = _mm_cmpgt_epi32(expMant, _mm_set1_epi32(0x7bff));
+        __m128 infNanExp = _mm_and_ps(_mm_castsi128_ps(infNan),
+                                      _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+        return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infNanExp));
+    }
+    // Low and high signed 16 bits of each 32-bit value, as floats; lanes at or past
+    // count are zero
+    static void LoadInt16Pairs(const unsigned int *p, const int &count, Reg &lo,
+                               Reg &hi) {
+        unsigned int v[Width] = {0, 0, 0, 0};
+        for (int i = 0; i < count; i++) {
+            v[i] = p[i];
+        }
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v));
+        lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(x, 16), 16));
+        hi = _mm_cvtepi32_ps(_mm_srai_epi32(x, 16));
+    }
+    static Reg Add(const Reg &a, const Reg &b) { return _mm_add_ps(a, b); }
+    static Reg Sub(const Reg &a, const Reg &b) { return _mm_sub_ps(a, b); }
+    static Reg Mul(const Reg &a, const Reg &b) { return _mm_mul_ps(a, b); }
+    static Reg Div(const Reg &a, const Reg &b) { return _mm_div_ps(a, b); }
+    static Reg Fmadd(const Reg &a, const Reg &b, const Reg &c) {
+        return _mm_add_ps(_mm_mul_ps(a, b), c);
+    }
+    static Reg Min(const Reg &a, const Reg &b) { return _mm_min_ps(a, b); }
+    static Reg Max(const Reg &a, const Reg &b) { return _mm_max_ps(a, b); }
+    static Reg Abs(const Reg &a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+    // Magnitude of mag with the sign of sign
+    static Reg CopySign(const Reg &mag, const Reg &sign) {
+        __m128 signBit = _mm_set1_ps(-0.f);
+        return _mm_or_ps(_mm_andnot_ps(signBit, mag), _mm_and_ps(signBit, sign));
+    }
+    static Reg Sqrt(const Reg &a) { return _mm_sqrt_ps(a); }
+    static Reg Round(const Reg &a) {
+        return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+    // 2^n for integral n in [-126, 127]
+    static Reg Pow2(const Reg &n) {
+        __m128i e = _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+    }
+    static Mask GreaterThanZero(const Reg &a) {
+        return _mm_cmpgt_ps(a, _mm_setzero_ps());
+    }
+    static Mask FirstLanes(const int &count) {
+        return _mm_cmplt_ps(Iota(), _mm_set1_ps(float(count)));
+    }
+    static Reg ZeroUnless(const Mask &m, const Reg &a) { return _mm_and_ps(m, a); }
+    static float HSum(const Reg &a) {
+        __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+} // namespace
+
+void JointBilateralSpanSSE4(const JointBilateralKernelParams &params, const int &y,
+                            const int &x0, const int &x1) {
+    JointBilateralSpan<VecSSE4>(params, y, x0, x1);
+}
+
+#endif
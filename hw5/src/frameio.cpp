@@ -0,0 +1,273 @@
+#include "frameio.h"
+#include "util/trace.h"
+
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::vector<Matrix4x4> ReadMatrix(const std::string &filename) {
+    std::ifstream is;
+    is.open(filename, std::ios::binary);
+    CHECK(is.is_open());
+    int shapeNum;
+    is.read(reinterpret_cast<char *>(&shapeNum), sizeof(int));
+    std::vector<Matrix4x4> matrix(shapeNum + 2);
+    for (int i = 0; i < shapeNum + 2; i++) {
+        is.read(reinterpret_cast<char *>(&matrix[i]), sizeof(Matrix4x4));
+    }
+    is.close();
+    return matrix;
+}
+
+FrameInfo LoadFrameInfoExr(const filesystem::path &inputDir, const int &idx,
+                           const unsigned &channels) {
+    auto file = [&](const std::string &name) {
+        return (inputDir / (name + "_" + std::to_string(idx) + ".exr")).str();
+    };
+    FrameInfo frameInfo;
+    if (channels & kFrameBeauty) {
+        frameInfo.m_beauty = ReadFloat3Image(file("beauty"));
+    }
+    if (channels & kFrameNormal) {
+        frameInfo.m_normal = ReadFloat3Image(file("normal"));
+    }
+    if (channels & kFramePosition) {
+        frameInfo.m_position = ReadFloat3Image(file("position"));
+    }
+    if (channels & kFrameDepth) {
+        frameInfo.m_depth = ReadFloatImage(file("depth"));
+    }
+    if (channels & kFrameId) {
+        frameInfo.m_id = ReadFloatImage(file("ID"));
+    }
+    frameInfo.m_matrix =
+        ReadMatrix((inputDir / ("matrix_" + std::to_string(idx) + ".mat")).str());
+    return frameInfo;
+}
+
+filesystem::path LayeredFramePath(const filesystem::path &dir, const int &idx) {
+    return dir / ("frame_" + std::to_string(idx) + ".exr");
+}
+
+FrameInfo LoadFrameInfoLayered(const filesystem::path &inputDir, const int &idx,
+                               const unsigned &channels) {
+    // Only the requested layers are converted into planes
+    std::vector<std::string> names;
+    auto request = [&](const FrameChannel &channel, const std::string &layer,
+                       const std::string &suffixes) {
+        if (channels & channel) {
+            for (const char &suffix : suffixes) {
+                names.push_back(layer + "." + suffix);
+            }
+        }
+    };
+    request(kFrameBeauty, "beauty", "RGB");
+    request(kFrameNormal, "normal", "RGB");
+    request(kFramePosition, "position", "RGB");
+    request(kFrameDepth, "depth", "Y");
+    request(kFrameId, "ID", "Y");
+    std::vector<Buffer2D<float>> planes =
+        ReadFloatImageChannels(LayeredFramePath(inputDir, idx).str(), names);
+
+    FrameInfo frameInfo;
+    int next = 0;
+    auto planar = [&](const FrameChannel &channel, PlanarBuffer2D<float> &buffer) {
+        if (channels & channel) {
+            buffer =
+                PlanarBuffer2D<float>(planes[next], planes[next + 1], planes[next + 2]);
+            next += 3;
+        }
+    };
+    auto single = [&](const FrameChannel &channel, Buffer2D<float> &buffer) {
+        if (channels & channel) {
+            buffer = planes[next++];
+        }
+    };
+    planar(kFrameBeauty, frameInfo.m_beauty);
+    planar(kFrameNormal, frameInfo.m_normal);
+    planar(kFramePosition, frameInfo.m_position);
+    single(kFrameDepth, frameInfo.m_depth);
+    single(kFrameId, frameInfo.m_id);
+    frameInfo.m_matrix =
+        ReadMatrix((inputDir / ("matrix_" + std::to_string(idx) + ".mat")).str());
+    return frameInfo;
+}
+
+filesystem::path FramePackagePath(const filesystem::path &dir, const int &idx) {
+    return dir / ("frame_" + std::to_string(idx) + ".hqfp");
+}
+
+static uint64_t AlignOffset(const uint64_t &offset) {
+    return (offset + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+}
+
+static const float *PackagePlane(const FrameInfo &frameInfo, const int &plane) {
+    switch (plane) {
+    case kPackDepth:
+        return frameInfo.m_depth.m_buffer.get();
+    case kPackId:
+        return frameInfo.m_id.m_buffer.get();
+    default:
+        break;
+    }
+    const PlanarBuffer2D<float> *planar[3] = {&frameInfo.m_beauty, &frameInfo.m_normal,
+                                              &frameInfo.m_position};
+    return planar[plane / 3]->Plane(plane % 3);
+}
+
+void WriteFramePackage(const std::string &filename, const FrameInfo &frameInfo) {
+    int width = frameInfo.m_beauty.m_width;
+    int height = frameInfo.m_beauty.m_height;
+    uint64_t planeBytes = sizeof(float) * static_cast<uint64_t>(width) * height;
+
+    FramePackageHeader header = {};
+    std::memcpy(header.magic, kFramePackageMagic, sizeof(header.magic));
+    header.version = kFramePackageVersion;
+    header.width = width;
+    header.height = height;
+    header.matrixNum = static_cast<int32_t>(frameInfo.m_matrix.size());
+    uint64_t offset = AlignOffset(sizeof(FramePackageHeader));
+    for (int plane = 0; plane < kPackPlaneNum; plane++) {
+        header.planeOffset[plane] = offset;
+        offset = AlignOffset(offset + planeBytes);
+    }
+    header.matrixOffset = offset;
+    header.fileSize = offset + sizeof(Matrix4x4) * frameInfo.m_matrix.size();
+
+    std::ofstream os(filename, std::ios::binary | std::ios::trunc);
+    CHECK(os.is_open());
+    auto writeAt = [&](const uint64_t &at, const void *data, const uint64_t &size) {
+        static const char zeros[kBufferAlignment] = {};
+        uint64_t pos = static_cast<uint64_t>(os.tellp());
+        os.write(zeros, static_cast<std::streamsize>(at - pos));
+        os.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+    };
+    writeAt(0, &header, sizeof(header));
+    for (int plane = 0; plane < kPackPlaneNum; plane++) {
+        writeAt(header.planeOffset[plane], PackagePlane(frameInfo, plane), planeBytes);
+    }
+    writeAt(header.matrixOffset, frameInfo.m_matrix.data(),
+            sizeof(Matrix4x4) * frameInfo.m_matrix.size());
+    CHECK(os.good());
+}
+
+// Read-only file mapped copy-on-write, unmapped with the last buffer using it
+class FileMapping {
+  public:
+    explicit FileMapping(const std::string &filename) {
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        CHECK(file != INVALID_HANDLE_VALUE);
+        LARGE_INTEGER size;
+        CHECK(GetFileSizeEx(file, &size));
+        m_size = static_cast<size_t>(size.QuadPart);
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        CHECK(mapping != nullptr);
+        m_data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        CHECK(m_data != nullptr);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        CHECK(fd >= 0);
+        struct stat st;
+        CHECK(fstat(fd, &st) == 0);
+        m_size = static_cast<size_t>(st.st_size);
+        void *data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        CHECK(data != MAP_FAILED);
+        m_data = data;
+#endif
+    }
+
+    ~FileMapping() {
+#if defined(_WIN32)
+        UnmapViewOfFile(m_data);
+#else
+        munmap(m_data, m_size);
+#endif
+    }
+
+    FileMapping(const FileMapping &) = delete;
+    FileMapping &operator=(const FileMapping &) = delete;
+
+    char *Data() const { return static_cast<char *>(m_data); }
+    size_t Size() const { return m_size; }
+
+  private:
+    void *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+FrameInfo MapFramePackage(const std::string &filename, const unsigned &channels) {
+    std::shared_ptr<FileMapping> mapping = std::make_shared<FileMapping>(filename);
+    CHECK(mapping->Size() >= sizeof(FramePackageHeader));
+
+    FramePackageHeader header;
+    std::memcpy(&header, mapping->Data(), sizeof(header));
+    CHECK(std::memcmp(header.magic, kFramePackageMagic, sizeof(header.magic)) == 0);
+    CHECK(header.version == kFramePackageVersion);
+    CHECK(header.fileSize <= mapping->Size());
+    int width = header.width, height = header.height;
+    uint64_t planeBytes = sizeof(float) * static_cast<uint64_t>(width) * height;
+
+    // Aliasing shared_ptrs: each plane points into the mapping and shares its lifetime
+    Buffer2D<float> planes[kPackPlaneNum];
+    for (int plane = 0; plane < kPackPlaneNum; plane++) {
+        uint64_t offset = header.planeOffset[plane];
+        CHECK(offset % kBufferAlignment == 0 && offset + planeBytes <= header.fileSize);
+        float *data = reinterpret_cast<float *>(mapping->Data() + offset);
+        planes[plane] =
+            Buffer2D<float>(std::shared_ptr<float[]>(mapping, data), width, height);
+    }
+
+    CHECK(header.matrixOffset + sizeof(Matrix4x4) * header.matrixNum <= header.fileSize);
+    std::vector<Matrix4x4> matrix(header.matrixNum);
+    std::memcpy(matrix.data(), mapping->Data() + header.matrixOffset,
+                sizeof(Matrix4x4) * header.matrixNum);
+
+    // Planes left out are never touched, so their pages are never read
+    FrameInfo frameInfo;
+    if (channels & kFrameBeauty) {
+        frameInfo.m_beauty = PlanarBuffer2D<float>(
+            planes[kPackBeautyX], planes[kPackBeautyY], planes[kPackBeautyZ]);
+    }
+    if (channels & kFrameNormal) {
+        frameInfo.m_normal = PlanarBuffer2D<float>(
+            planes[kPackNormalX], planes[kPackNormalY], planes[kPackNormalZ]);
+    }
+    if (channels & kFramePosition) {
+        frameInfo.m_position = PlanarBuffer2D<float>(
+            planes[kPackPositionX], planes[kPackPositionY], planes[kPackPositionZ]);
+    }
+    if (channels & kFrameDepth) {
+        frameInfo.m_depth = planes[kPackDepth];
+    }
+    if (channels & kFrameId) {
+        frameInfo.m_id = planes[kPackId];
+    }
+    frameInfo.m_matrix = matrix;
+    return frameInfo;
+}
+
+FrameInfo LoadFrameInfo(const filesystem::path &inputDir, const int &idx,
+                        const unsigned &channels) {
+    TRACE_FRAME_SCOPE("LoadFrameInfo", idx);
+    filesystem::path package = FramePackagePath(inputDir, idx);
+    if (package.exists()) {
+        return MapFramePackage(package.str(), channels);
+    }
+    if (LayeredFramePath(inputDir, idx).exists()) {
+        return LoadFrameInfoLayered(inputDir, idx, channels);
+    }
+    return LoadFrameInfoExr(inputDir, idx, channels);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "filesystem/path.h"
+
+#include "denoiser.h"
+
+// Frame package: every plane of a FrameInfo plus its matrices in one uncompressed
+// file, so a frame can be mapped instead of decoded. Little-endian, laid out as
+// FramePackageHeader followed by the planes (float, width * height each) and the
+// matrices, every section starting at a multiple of kBufferAlignment.
+const char kFramePackageMagic[4] = {'H', 'Q', 'F', 'P'};
+const uint32_t kFramePackageVersion = 1;
+
+enum FramePackagePlane {
+    kPackBeautyX, kPackBeautyY, kPackBeautyZ,
+    kPackNormalX, kPackNormalY, kPackNormalZ,
+    kPackPositionX, kPackPositionY, kPackPositionZ,
+    kPackDepth,
+    kPackId,
+    kPackPlaneNum
+};
+
+struct FramePackageHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t width, height;
+    int32_t matrixNum;
+    uint32_t reserved;
+    uint64_t planeOffset[kPackPlaneNum]; // in bytes from the start of the file
+    uint64_t matrixOffset;
+    uint64_t fileSize;
+};
+
+std::vector<Matrix4x4> ReadMatrix(const std::string &filename);
+
+// The loaders below only read the planes in channels (FrameChannel bits) and leave
+// the others empty
+
+// Frame idx from the per-frame EXR and matrix files
+FrameInfo LoadFrameInfoExr(const filesystem::path &inputDir, const int &idx,
+                           const unsigned &channels = kFrameAllChannels);
+
+// Frame idx from a single multi-layer EXR frame_<idx>.exr, decoded in one pass, plus
+// its matrix file. Layers beauty, normal and position have channels R, G, B; depth
+// and ID have channel Y, e.g. "normal.G" or "ID.Y".
+filesystem::path LayeredFramePath(const filesystem::path &dir, const int &idx);
+FrameInfo LoadFrameInfoLayered(const filesystem::path &inputDir, const int &idx,
+                               const unsigned &channels = kFrameAllChannels);
+
+filesystem::path FramePackagePath(const filesystem::path &dir, const int &idx);
+void WriteFramePackage(const std::string &filename, const FrameInfo &frameInfo);
+// Map a frame package copy-on-write; the buffers of the returned frame point into
+// the mapping, which stays alive as long as any of them
+FrameInfo MapFramePackage(const std::string &filename,
+                          const unsigned &channels = kFrameAllChannels);
+
+// Frame idx from its package if inputDir has one, else from its multi-layer EXR if
+// there is one, else from the per-frame EXR files
+FrameInfo LoadFrameInfo(const filesystem::path &inputDir, const int &idx,
+                        const unsigned &channels = kFrameAllChannels);
@@ -0,0 +1,64 @@
+#include "framepipeline.h"
+#include "util/trace.h"
+
+FramePipeline::FramePipeline(Denoiser &denoiser)
+    : m_denoiser(denoiser), m_filterThread(&FramePipeline::FilterMain, this) {}
+
+FramePipeline::~FramePipeline() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_pushedFrame.notify_one();
+    m_filterThread.join();
+}
+
+void FramePipeline::Push(const FrameInfo &frameInfo) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_frames.push_back({frameInfo, PlanarBuffer2D<float>()});
+        m_pushed++;
+    }
+    m_pushedFrame.notify_one();
+}
+
+PlanarBuffer2D<float> FramePipeline::Pop() {
+    Frame frame;
+    {
+        TRACE_SCOPE("WaitFilterStage");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        CHECK(m_popped < m_pushed);
+        m_filteredFrame.wait(lock, [&]() { return m_filtered > m_popped; });
+        frame = std::move(m_frames.front());
+        m_frames.pop_front();
+        m_popped++;
+    }
+    return m_denoiser.TemporalStage(frame.frameInfo, frame.filteredColor);
+}
+
+int FramePipeline::Pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_pushed - m_popped);
+}
+
+void FramePipeline::FilterMain() {
+    SetTraceThreadName("filter stage");
+    for (;;) {
+        Frame *frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_pushedFrame.wait(lock, [&]() { return m_stop || m_filtered < m_pushed; });
+            if (m_stop) {
+                return;
+            }
+            frame = &m_frames[m_filtered - m_popped];
+        }
+        // Frames are only popped once filtered, so frame stays put meanwhile
+        frame->filteredColor = m_denoiser.FilterStage(frame->frameInfo);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_filtered++;
+        }
+        m_filteredFrame.notify_one();
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "denoiser.h"
+
+// Frame-level task graph of a Denoiser: the filter stage of every frame follows the
+// filter stage of the frame before (they share its work lists), the temporal stage
+// follows the frame's own filter stage and the temporal stage of the frame before.
+// Filter stages run on a thread of the pipeline, temporal stages on the thread
+// calling Pop, so the filter of the frames pushed ahead overlaps the temporal stages
+// of the current one. On the scheduler (Denoiser::m_tilePipeline) the filter graph
+// of the later frame and the temporal graph of the current one share its workers.
+// Results match calling ProcessFrame on every frame in turn.
+class FramePipeline {
+  public:
+    explicit FramePipeline(Denoiser &denoiser);
+    ~FramePipeline();
+
+    // Queue the next frame, its filter stage starts as soon as the one before is done
+    void Push(const FrameInfo &frameInfo);
+    // Result of the oldest frame not popped yet, which must have been pushed
+    PlanarBuffer2D<float> Pop();
+    // Frames pushed and not popped yet
+    int Pending() const;
+
+  private:
+    struct Frame {
+        FrameInfo frameInfo;
+        PlanarBuffer2D<float> filteredColor;
+    };
+
+    void FilterMain();
+
+    Denoiser &m_denoiser;
+    // Frames m_popped .. m_pushed - 1; the first m_filtered - m_popped are filtered.
+    // Elements keep their address while others are pushed and popped.
+    std::deque<Frame> m_frames;
+    long long m_pushed = 0, m_popped = 0, m_filtered = 0;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_pushedFrame, m_filteredFrame;
+    bool m_stop = false;
+    std::thread m_filterThread;
+};
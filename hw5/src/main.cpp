@@ -1,53 +1,112 @@
-#include <fstream>
+#include <algorithm>
+#include <deque>
+#include <future>
 #include <string>
 
 #include "denoiser.h"
+#include "frameio.h"
+#include "framepipeline.h"
 #include "util/image.h"
 #include "util/mathutil.h"
+#include "util/trace.h"
+#include "util/workerpool.h"
 
-std::vector<Matrix4x4> ReadMatrix(const std::string &filename) {
-    std::ifstream is;
-    is.open(filename, std::ios::binary);
-    CHECK(is.is_open());
-    int shapeNum;
-    is.read(reinterpret_cast<char *>(&shapeNum), sizeof(int));
-    std::vector<Matrix4x4> matrix(shapeNum + 2);
-    for (int i = 0; i < shapeNum + 2; i++) {
-        is.read(reinterpret_cast<char *>(&matrix[i]), sizeof(Matrix4x4));
+// Write the result (and motion) of one frame. Runs on a write-behind thread, so it
+// gets its own copies: the denoiser reuses its buffers on the next frame.
+void WriteFrame(const filesystem::path &outputDir, const int &idx,
+                const PlanarBuffer2D<float> &image, const PlanarBuffer2D<float> &motion,
+                const ImageWriteOptions &options) {
+    TRACE_FRAME_SCOPE("WriteFrame", idx);
+    WriteFloat3Image(image,
+                     (outputDir / ("result_" + std::to_string(idx) + ".exr")).str(),
+                     options);
+    if (motion.m_width > 0) {
+        WriteFloat3Image(motion,
+                         (outputDir / ("motion_" + std::to_string(idx) + ".exr")).str(),
+                         options);
     }
-    is.close();
-    return matrix;
-}
-
-FrameInfo LoadFrameInfo(const filesystem::path &inputDir, const int &idx) {
-    Buffer2D<Float3> beauty =
-        ReadFloat3Image((inputDir / ("beauty_" + std::to_string(idx) + ".exr")).str());
-    Buffer2D<Float3> normal =
-        ReadFloat3Image((inputDir / ("normal_" + std::to_string(idx) + ".exr")).str());
-    Buffer2D<Float3> position =
-        ReadFloat3Image((inputDir / ("position_" + std::to_string(idx) + ".exr")).str());
-    Buffer2D<float> depth =
-        ReadFloatImage((inputDir / ("depth_" + std::to_string(idx) + ".exr")).str());
-    Buffer2D<float> id =
-        ReadFloatImage((inputDir / ("ID_" + std::to_string(idx) + ".exr")).str());
-    std::vector<Matrix4x4> matrix =
-        ReadMatrix((inputDir / ("matrix_" + std::to_string(idx) + ".mat")).str());
-
-    FrameInfo frameInfo = {beauty, depth, normal, position, id, matrix};
-    return frameInfo;
 }
 
 void Denoise(const filesystem::path &inputDir, const filesystem::path &outputDir,
-             const int &frameNum) {
+             const int &frameNum, const bool &exportMotion, const int &prefetchDepth,
+             const int &filterLookahead, const int &writerNum,
+             const ImageWriteOptions &outputOptions, const Precision &colorPrecision,
+             const Precision &guidePrecision, const bool &compactGBuffer,
+             const bool &tilePipeline, const bool &perfCounters) {
     Denoiser denoiser;
+    denoiser.m_tilePipeline = tilePipeline;
+    denoiser.m_colorPrecision = colorPrecision;
+    denoiser.m_perfCounters = perfCounters;
+    denoiser.m_guidePrecision = guidePrecision;
+    // Only the planes the denoiser reads are decoded
+    unsigned channels = denoiser.RequiredChannels();
+
+    // Frames i+1..i+prefetchDepth decode in the background while frame i is
+    // denoised, at most writerNum results are being encoded at once. Both queues
+    // are drained in frame order, which bounds the frames held in memory. Each runs
+    // on a pool of as many persistent threads.
+    WorkerPool loaders(prefetchDepth, "loader");
+    WorkerPool writers(writerNum, "writer");
+    std::deque<std::future<FrameInfo>> loads;
+    std::deque<std::future<void>> writes;
+    int nextLoad = 0;
+    auto prefetch = [&]() {
+        while (nextLoad < frameNum &&
+               static_cast<int>(loads.size()) < std::max(prefetchDepth, 1)) {
+            int idx = nextLoad++;
+            loads.push_back(loaders.Submit([=]() {
+                FrameInfo frameInfo = LoadFrameInfo(inputDir, idx, channels);
+                if (compactGBuffer) {
+                    TRACE_FRAME_SCOPE("CompactFrameInfo", idx);
+                    CompactFrameInfo(frameInfo);
+                }
+                return frameInfo;
+            }));
+        }
+    };
+
+    // Frames i+1..i+filterLookahead are filtered while frame i goes through the
+    // temporal stages
+    SetTraceThreadName("denoise");
+    FramePipeline pipeline(denoiser);
+    int nextPush = 0;
     for (int i = 0; i < frameNum; i++) {
+        while (nextPush < frameNum && nextPush <= i + std::max(filterLookahead, 0)) {
+            prefetch();
+            pipeline.Push(loads.front().get());
+            loads.pop_front();
+            nextPush++;
+            prefetch();
+        }
+
         std::cout << "Frame: " << i << std::endl;
-        FrameInfo frameInfo = LoadFrameInfo(inputDir, i);
-        Buffer2D<Float3> image = denoiser.ProcessFrame(frameInfo);
-        std::string filename =
-            (outputDir / ("result_" + std::to_string(i) + ".exr")).str();
-        WriteFloat3Image(image, filename);
+        PlanarBuffer2D<float> result = pipeline.Pop();
+        PlanarBuffer2D<float> image;
+        // No motion for the first frame, it has no history
+        PlanarBuffer2D<float> motion;
+        {
+            TRACE_FRAME_SCOPE("CopyResult", i);
+            image.Copy(result);
+            if (exportMotion && denoiser.m_motion.m_width > 0) {
+                motion.Copy(denoiser.m_motion);
+            }
+        }
+
+        while (static_cast<int>(writes.size()) >= std::max(writerNum, 1)) {
+            writes.front().get();
+            writes.pop_front();
+        }
+        writes.push_back(writers.Submit([&outputDir, &outputOptions, i,
+                                         image = std::move(image),
+                                         motion = std::move(motion)]() {
+            WriteFrame(outputDir, i, image, motion, outputOptions);
+        }));
+    }
+
+    for (std::future<void> &write : writes) {
+        write.get();
     }
+    denoiser.PrintBufferReport();
 }
 
 int main() {
@@ -61,6 +120,52 @@ int main() {
     //filesystem::path outputDir("../examples/pink-room/output");
     //int frameNum = 80;
 
-    Denoise(inputDir, outputDir, frameNum);
+    // Also write the per-pixel motion vectors (x, y) and history validity (z)
+    bool exportMotion = false;
+
+    // Frames decoded ahead of the one being denoised, and results encoded in parallel
+    int prefetchDepth = 2;
+    int writerNum = 2;
+    // Frames filtered ahead of the one in the temporal stages (0 for one at a time)
+    int filterLookahead = 1;
+    // Threads every EXR decode/encode uses for its chunks (0 for all cores), OpenMP
+    // builds only
+    SetImageThreads(2);
+
+    // Output storage, e.g. ZIP or PIZ to save disk space at the cost of write time,
+    // full float to keep the precision
+    ImageWriteOptions outputOptions;
+    outputOptions.compression = ImageCompression::None;
+    outputOptions.halfFloat = true;
+
+    // Storage of the accumulated color and of the filter guides (beauty, normal);
+    // Half halves their memory and bandwidth, compute stays float
+    Precision colorPrecision = Precision::Float;
+    Precision guidePrecision = Precision::Float;
+
+    // Encode normals, IDs and positions compactly as frames are loaded (octahedral
+    // normals, 16-bit IDs, positions rebuilt from depth); frames whose IDs do not fit
+    // 16 bits stay full
+    bool compactGBuffer = false;
+
+    // Chrome trace-event JSON of the stages of every frame and thread, written to the
+    // output directory (open in chrome://tracing or ui.perfetto.dev); empty for none
+    std::string traceFile = "";
+    // Run the filter and temporal passes as task graphs on the work-stealing scheduler;
+    // false falls back to one OpenMP parallel loop per pass
+    bool tilePipeline = true;
+    // Report cycles, instructions, LLC and branch misses per stage (Linux perf events),
+    // OpenMP fallback only
+    bool perfCounters = false;
+
+    if (!traceFile.empty()) {
+        StartTrace();
+    }
+    Denoise(inputDir, outputDir, frameNum, exportMotion, prefetchDepth, filterLookahead,
+            writerNum, outputOptions, colorPrecision, guidePrecision, compactGBuffer,
+            tilePipeline, perfCounters);
+    if (!traceFile.empty() && !WriteTrace((outputDir / traceFile).str())) {
+        std::cerr << "Cannot write trace " << traceFile << std::endl;
+    }
     return 0;
 }
\ No newline at end of file
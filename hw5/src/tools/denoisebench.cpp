@@ -0,0 +1,208 @@
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include <benchmark/benchmark.h>
+
+#include "denoiser.h"
+#include "syntheticframe.h"
+
+// Micro-benchmarks of the denoiser stages on synthetic frames, so no example data is
+// needed. Every case reports pixels/s (items) and bytes/s, where the bytes are those
+// of the planes the stage streams through once per pixel. For a baseline, e.g.
+//   DenoiseBench --benchmark_out=base.json --benchmark_out_format=json
+// and compare runs with Google Benchmark's tools/compare.py.
+
+// 720p, 1080p and 4K
+static const int kResolutions[3][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+static const int kKernelRadii[4] = {4, 8, 16, 32};
+
+// Frames are generated once per size and seed and shared by all cases
+static const FrameInfo &SyntheticFrame(const int &width, const int &height,
+                                       const int &seed) {
+    static std::map<std::tuple<int, int, int>, FrameInfo> frames;
+    std::tuple<int, int, int> key(width, height, seed);
+    auto it = frames.find(key);
+    if (it == frames.end()) {
+        it = frames.emplace(key, MakeSyntheticFrame(width, height, seed)).first;
+    }
+    return it->second;
+}
+
+static void SetProcessed(benchmark::State &state, const int &width, const int &height,
+                         const int &bytesPerPixel) {
+    int64_t pixels = static_cast<int64_t>(width) * height * state.iterations();
+    state.SetItemsProcessed(pixels);
+    state.SetBytesProcessed(pixels * bytesPerPixel);
+}
+
+// Spatial filter of one frame; args: width, height, kernel radius
+static void FilterBenchmark(benchmark::State &state, const FilterMode &mode) {
+    int width = state.range(0), height = state.range(1);
+    const FrameInfo &frameInfo = SyntheticFrame(width, height, 0);
+    Denoiser denoiser;
+    denoiser.m_filterMode = mode;
+    denoiser.m_kernelRadius = state.range(2);
+    denoiser.BuildFilterWork(frameInfo);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(denoiser.Filter(frameInfo));
+    }
+    // Guides in, filtered color out
+    SetProcessed(state, width, height, denoiser.FilterBytesPerTap(false) + 12);
+}
+
+static void BM_JointBilateralFilter(benchmark::State &state) {
+    FilterBenchmark(state, FilterMode::JointBilateral);
+}
+
+static void BM_ATrousFilter(benchmark::State &state) {
+    FilterBenchmark(state, FilterMode::ATrous);
+}
+
+static void FilterArgs(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"width", "height", "radius"});
+    for (const int(&resolution)[2] : kResolutions) {
+        for (const int &radius : kKernelRadii) {
+            benchmark->Args({resolution[0], resolution[1], radius});
+        }
+    }
+}
+
+// Denoiser that has seen frame 0 and is set up for the temporal stages of frame 1
+static void PrepareTemporal(Denoiser &denoiser, const FrameInfo &frameInfo) {
+    const FrameInfo &first =
+        SyntheticFrame(frameInfo.m_beauty.m_width, frameInfo.m_beauty.m_height, 0);
+    denoiser.ProcessFrame(first);
+    denoiser.BuildRowWork(frameInfo);
+}
+
+// Bytes of the accumulated color per pixel
+static int ColorBytes(const Denoiser &denoiser) {
+    return denoiser.m_colorPrecision == Precision::Half ? 3 * sizeof(Half) : 12;
+}
+
+// Args: width, height
+static void BM_Reprojection(benchmark::State &state) {
+    int width = state.range(0), height = state.range(1);
+    const FrameInfo &frameInfo = SyntheticFrame(width, height, 1);
+    Denoiser denoiser;
+    PrepareTemporal(denoiser, frameInfo);
+    for (auto _ : state) {
+        denoiser.Reprojection(frameInfo);
+    }
+    // G-buffer and history in, history, motion and validity out
+    int bytes =
+        denoiser.ReprojectionBytesPerPixel(false) + 2 * ColorBytes(denoiser) + 12 + 1;
+    SetProcessed(state, width, height, bytes);
+}
+
+static void BM_TemporalAccumulation(benchmark::State &state) {
+    int width = state.range(0), height = state.range(1);
+    const FrameInfo &frameInfo = SyntheticFrame(width, height, 1);
+    Denoiser denoiser;
+    PrepareTemporal(denoiser, frameInfo);
+    denoiser.Reprojection(frameInfo);
+    for (auto _ : state) {
+        denoiser.TemporalAccumulation(frameInfo, frameInfo.m_beauty);
+    }
+    // Current color, validity and history in, accumulated color out
+    SetProcessed(state, width, height, 12 + 1 + 2 * ColorBytes(denoiser));
+}
+
+static void BM_FusedTemporalAccumulation(benchmark::State &state) {
+    int width = state.range(0), height = state.range(1);
+    const FrameInfo &frameInfo = SyntheticFrame(width, height, 1);
+    Denoiser denoiser;
+    PrepareTemporal(denoiser, frameInfo);
+    for (auto _ : state) {
+        denoiser.FusedTemporalAccumulation(frameInfo, frameInfo.m_beauty);
+    }
+    // G-buffer, current color and history in, accumulated color and motion out
+    int bytes =
+        denoiser.ReprojectionBytesPerPixel(false) + 12 + 2 * ColorBytes(denoiser) + 12;
+    SetProcessed(state, width, height, bytes);
+}
+
+static void ResolutionArgs(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"width", "height"});
+    for (const int(&resolution)[2] : kResolutions) {
+        benchmark->Args({resolution[0], resolution[1]});
+    }
+}
+
+static void BM_Inverse(benchmark::State &state) {
+    Matrix4x4 m = MakeWorldToScreen(1920, 1080, 0.5f);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(m);
+        benchmark::DoNotOptimize(Inverse(m));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * sizeof(Matrix4x4));
+}
+
+// EXR file of a synthetic beauty image in the temporary directory, for the I/O cases
+static std::string ImagePath(const int &width, const int &height) {
+    std::string name =
+        "denoisebench_" + std::to_string(width) + "x" + std::to_string(height) + ".exr";
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// Args: width, height; bytes are those of the file
+static void BM_WriteFloat3Image(benchmark::State &state) {
+    int width = state.range(0), height = state.range(1);
+    const FrameInfo &frameInfo = SyntheticFrame(width, height, 0);
+    std::string path = ImagePath(width, height);
+    for (auto _ : state) {
+        WriteFloat3Image(frameInfo.m_beauty, path);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(width) * height * state.iterations());
+    state.SetBytesProcessed(std::filesystem::file_size(path) * state.iterations());
+    std::remove(path.c_str());
+}
+
+static void BM_ReadFloat3Image(benchmark::State &state) {
+    int width = state.range(0), height = state.range(1);
+    std::string path = ImagePath(width, height);
+    WriteFloat3Image(SyntheticFrame(width, height, 0).m_beauty, path);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ReadFloat3Image(path));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(width) * height * state.iterations());
+    state.SetBytesProcessed(std::filesystem::file_size(path) * state.iterations());
+    std::remove(path.c_str());
+}
+
+// The stages run on OpenMP threads, so time by the wall clock
+BENCHMARK(BM_JointBilateralFilter)
+    ->Apply(FilterArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ATrousFilter)
+    ->Apply(FilterArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Reprojection)
+    ->Apply(ResolutionArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TemporalAccumulation)
+    ->Apply(ResolutionArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FusedTemporalAccumulation)
+    ->Apply(ResolutionArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Inverse);
+BENCHMARK(BM_WriteFloat3Image)
+    ->Apply(ResolutionArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ReadFloat3Image)
+    ->Apply(ResolutionArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,24 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "frameio.h"
+
+// Convert the per-frame EXR and matrix files of a sequence into frame packages,
+// which LoadFrameInfo then maps instead of decoding the EXRs
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cout << "Usage: PackFrames <input dir> <frame count> [output dir]"
+                  << std::endl;
+        return 1;
+    }
+    filesystem::path inputDir(argv[1]);
+    int frameNum = std::atoi(argv[2]);
+    filesystem::path outputDir(argc > 3 ? argv[3] : argv[1]);
+
+    for (int i = 0; i < frameNum; i++) {
+        std::cout << "Frame: " << i << std::endl;
+        FrameInfo frameInfo = LoadFrameInfoExr(inputDir, i);
+        WriteFramePackage(FramePackagePath(outputDir, i).str(), frameInfo);
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#include "denoiser.h"
+#include "syntheticframe.h"
+
+// Check the vectorized joint bilateral filter against the scalar reference
+// (m_simdLevel = SimdLevel::Scalar): every SIMD level the CPU supports filters
+// synthetic frames in each guide layout, and the largest relative error of any
+// channel must stay within the tolerance filterkernel.h promises. Exits with 1
+// otherwise; ctest runs it.
+
+static const float kTolerance = 1e-4f;
+
+struct CheckCase {
+    const char *name;
+    Precision guidePrecision;
+    bool compact;
+    float sigmaNormal, sigmaPlane;
+};
+
+static const CheckCase kCases[] = {
+    {"float guides", Precision::Float, false, 0.1f, 0.1f},
+    {"half guides", Precision::Half, false, 0.1f, 0.1f},
+    {"compact", Precision::Float, true, 0.1f, 0.1f},
+    {"compact, half beauty", Precision::Half, true, 0.1f, 0.1f},
+    {"no normal term", Precision::Float, false, 0.f, 0.1f},
+    {"no plane term", Precision::Float, false, 0.1f, 0.f},
+};
+static const int kKernelRadii[2] = {3, 10};
+
+static PlanarBuffer2D<float> FilterFrame(const FrameInfo &frameInfo,
+                                         const CheckCase &check, const int &radius,
+                                         const SimdLevel &level) {
+    Denoiser denoiser;
+    denoiser.m_simdLevel = level;
+    denoiser.m_guidePrecision = check.guidePrecision;
+    denoiser.m_sigmaNormal = check.sigmaNormal;
+    denoiser.m_sigmaPlane = check.sigmaPlane;
+    denoiser.m_kernelRadius = radius;
+    denoiser.BuildFilterWork(frameInfo);
+    return denoiser.Filter(frameInfo);
+}
+
+// Largest |actual - expected| / |expected| over all pixels and channels
+static float MaxRelativeError(const PlanarBuffer2D<float> &expected,
+                              const PlanarBuffer2D<float> &actual) {
+    float maxError = 0.f;
+    size_t pixels = static_cast<size_t>(expected.m_width) * expected.m_height;
+    for (int c = 0; c < 3; c++) {
+        const float *e = expected.Plane(c), *a = actual.Plane(c);
+        for (size_t i = 0; i < pixels; i++) {
+            float error = std::abs(a[i] - e[i]);
+            maxError = std::max(maxError, e[i] != 0.f ? error / std::abs(e[i]) : error);
+        }
+    }
+    return maxError;
+}
+
+int main() {
+    const int width = 160, height = 90;
+    SimdLevel best = DetectSimdLevel();
+    bool passed = true;
+    for (const CheckCase &check : kCases) {
+        FrameInfo frameInfo = MakeSyntheticFrame(width, height, 0);
+        if (check.compact) {
+            CompactFrameInfo(frameInfo);
+        }
+        for (const int &radius : kKernelRadii) {
+            PlanarBuffer2D<float> expected =
+                FilterFrame(frameInfo, check, radius, SimdLevel::Scalar);
+            for (int l = static_cast<int>(SimdLevel::SSE4); l <= static_cast<int>(best);
+                 l++) {
+                SimdLevel level = static_cast<SimdLevel>(l);
+                float error = MaxRelativeError(
+                    expected, FilterFrame(frameInfo, check, radius, level));
+                bool ok = error <= kTolerance;
+                passed = passed && ok;
+                std::cout << std::left << std::setw(8) << SimdLevelName(level)
+                          << std::setw(22) << check.name << "radius " << std::right
+                          << std::setw(2) << radius << ": max relative error "
+                          << std::scientific << std::setprecision(2) << error
+                          << (ok ? "" : " FAILED") << std::endl;
+            }
+        }
+    }
+    if (best == SimdLevel::Scalar) {
+        std::cout << "No SIMD level supported, nothing to check" << std::endl;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cmath>
+#include <random>
+
+#include "denoiser.h"
+
+// Synthetic input of the tools that need no example data (DenoiseBench, SimdCheck)
+
+// Perspective world-to-screen matrix of a camera at (camX, 0, 5) looking down -z
+inline Matrix4x4 MakeWorldToScreen(const int &width, const int &height,
+                                   const float &camX) {
+    float n = 0.1f, f = 100.f, t = 1.f / std::tan(0.5f);
+    float proj[4][4] = {{t * height / width, 0, 0, 0},
+                        {0, t, 0, 0},
+                        {0, 0, (f + n) / (n - f), 2 * f * n / (n - f)},
+                        {0, 0, -1, 0}};
+    float view[4][4] = {{1, 0, 0, -camX}, {0, 1, 0, 0}, {0, 0, 1, -5}, {0, 0, 0, 1}};
+    float screen[4][4] = {{width / 2.f, 0, 0, width / 2.f},
+                          {0, height / 2.f, 0, height / 2.f},
+                          {0, 0, 0.5f, 0.5f},
+                          {0, 0, 0, 1}};
+    return Matrix4x4(screen) * Matrix4x4(proj) * Matrix4x4(view);
+}
+
+// Noisy frame of two objects (top and bottom half) in front of a background strip on
+// the left; the camera pans a little from one seed to the next
+inline FrameInfo MakeSyntheticFrame(const int &width, const int &height,
+                                    const int &seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> noise(0.f, 1.f);
+    FrameInfo frameInfo;
+    frameInfo.m_beauty = CreatePlanarBuffer2D<float>(width, height);
+    frameInfo.m_normal = CreatePlanarBuffer2D<float>(width, height);
+    frameInfo.m_position = CreatePlanarBuffer2D<float>(width, height);
+    frameInfo.m_depth = CreateBuffer2D<float>(width, height);
+    frameInfo.m_id = CreateBuffer2D<float>(width, height);
+    Matrix4x4 worldToScreen = MakeWorldToScreen(width, height, 0.01f * seed);
+    Matrix4x4 screenToWorld = Inverse(worldToScreen);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            bool background = x < width / 8;
+            float z = 0.98f + 0.01f * x / width + 0.002f * noise(rng);
+            Float3 color(x / static_cast<float>(width) + 0.2f * noise(rng),
+                         y / static_cast<float>(height), 0.5f * noise(rng));
+            Float3 normal = Normalize(
+                Float3(0.3f * noise(rng) - 0.15f, 0.1f, x > width / 2 ? 1.f : -1.f));
+            frameInfo.m_beauty.Set(x, y, color);
+            frameInfo.m_normal.Set(x, y, background ? Float3(0.f) : normal);
+            frameInfo.m_position.Set(
+                x, y,
+                background ? Float3(0.f)
+                           : screenToWorld(Float3(x + 0.5f, y + 0.5f, z), Float3::Point));
+            frameInfo.m_depth(x, y) = z;
+            frameInfo.m_id(x, y) = background ? -1.f : (y < height / 2 ? 0.f : 1.f);
+        }
+    }
+    frameInfo.m_matrix = {Matrix4x4(), Matrix4x4(), Matrix4x4(), worldToScreen};
+    return frameInfo;
+}
@@ -1,10 +1,29 @@
 #pragma once
 
+#include <cstddef>
 #include <cstring>
 #include <memory>
+#include <new>
+#include <type_traits>
 
+#include "bufferpool.h"
 #include "common.h"
 
+// Storage and control block both come from the buffer pool, so recycled buffers
+// cost no heap allocation at all
+template <typename T>
+inline std::shared_ptr<T[]> AllocateBuffer(const int &size) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "buffers never run element destructors");
+    size_t bytes = sizeof(T) * static_cast<size_t>(size);
+    T *buffer = static_cast<T *>(AcquireBufferBlock(bytes));
+    for (int i = 0; i < size; i++) {
+        new (buffer + i) T;
+    }
+    auto release = [bytes](T *ptr) { ReleaseBufferBlock(ptr, bytes); };
+    return std::shared_ptr<T[]>(buffer, release, BufferPoolAllocator<T>());
+}
+
 template <typename T>
 class Buffer {
   public:
@@ -16,29 +35,74 @@ class Buffer {
 };
 
 template <typename T>
-inline Buffer<T>::Buffer(T *buffer, const int &size) : m_buffer(buffer), m_size(size) {}
+inline Buffer<T>::Buffer(T *buffer, const int &size) : m_size(size) {
+    // A shared_ptr made from a null pointer still allocates a control block
+    if (buffer != nullptr) {
+        m_buffer.reset(buffer);
+    }
+}
 
 template <typename T>
 inline void Buffer<T>::Copy(const Buffer<T> &buffer) {
     if (m_buffer == buffer.m_buffer) {
         return;
     }
-    m_size = buffer.m_size;
-    m_buffer = std::shared_ptr<T[]>(new T[m_size]);
+    // Storage nobody else sees is overwritten in place
+    if (m_buffer == nullptr || m_buffer.use_count() > 1 || m_size != buffer.m_size) {
+        m_size = buffer.m_size;
+        m_buffer = AllocateBuffer<T>(m_size);
+    }
     std::memcpy(m_buffer.get(), buffer.m_buffer.get(), sizeof(T) * m_size);
 }
 
+// Non-owning view of a rectangle of a 2D buffer: element (x, y) is
+// m_data[y * m_stride + x]. Copying one touches no reference count and its accessors
+// do no bounds test (except with DENOISE_DEBUG_CHECKS), so hot loops take views
+// rather than buffers. A view is valid as long as the buffer it came from.
+template <typename T>
+struct BufferView2D {
+    T *Row(const int &y) const {
+        DCHECK(0 <= y && y < m_height);
+        return m_data + static_cast<ptrdiff_t>(y) * m_stride;
+    }
+    T &operator()(const int &x, const int &y) const {
+        DCHECK(0 <= x && x < m_width);
+        return Row(y)[x];
+    }
+    // Rectangle [x0, x1) x [y0, y1) of this view, in its coordinates
+    BufferView2D<T> SubView(const int &x0, const int &y0, const int &x1,
+                            const int &y1) const {
+        DCHECK(0 <= x0 && x0 <= x1 && x1 <= m_width);
+        DCHECK(0 <= y0 && y0 <= y1 && y1 <= m_height);
+        return {m_data + static_cast<ptrdiff_t>(y0) * m_stride + x0, x1 - x0, y1 - y0,
+                m_stride};
+    }
+    operator BufferView2D<const T>() const {
+        return {m_data, m_width, m_height, m_stride};
+    }
+
+    T *m_data;
+    int m_width, m_height;
+    int m_stride; // elements from one row to the next
+};
+
 template <typename T>
 class Buffer2D : public Buffer<T> {
   public:
     Buffer2D();
     Buffer2D(T *buffer, const int &width, const int &height);
+    Buffer2D(const std::shared_ptr<T[]> &buffer, const int &width, const int &height);
 
     void Copy(const Buffer2D<T> &buffer);
 
     T operator()(const int &x, const int &y) const;
     T &operator()(const int &x, const int &y);
 
+    BufferView2D<T> View() { return {this->m_buffer.get(), m_width, m_height, m_width}; }
+    BufferView2D<const T> View() const {
+        return {this->m_buffer.get(), m_width, m_height, m_width};
+    }
+
     int m_width, m_height;
 };
 
@@ -49,6 +113,13 @@ template <typename T>
 inline Buffer2D<T>::Buffer2D(T *buffer, const int &width, const int &height)
     : Buffer<T>(buffer, width * height), m_width(width), m_height(height) {}
 
+template <typename T>
+inline Buffer2D<T>::Buffer2D(const std::shared_ptr<T[]> &buffer, const int &width,
+                             const int &height)
+    : Buffer<T>(nullptr, width * height), m_width(width), m_height(height) {
+    this->m_buffer = buffer;
+}
+
 template <typename T>
 inline void Buffer2D<T>::Copy(const Buffer2D<T> &buffer) {
     Buffer<T>::Copy(buffer);
@@ -67,12 +138,11 @@ inline T Buffer2D<T>::operator()(const int &x, const int &y) const {
     if (0 <= x && x < m_width && 0 <= y && y < m_height) {
         return this->m_buffer[y * m_width + x];
     } else {
-        return T(0.0);
+        return T();
     }
 }
 
 template <typename T>
 inline Buffer2D<T> CreateBuffer2D(const int &width, const int &height) {
-    T *buffer = new T[width * height];
-    return Buffer2D<T>(buffer, width, height);
+    return Buffer2D<T>(AllocateBuffer<T>(width * height), width, height);
 }
\ No newline at end of file
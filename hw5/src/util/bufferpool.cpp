@@ -0,0 +1,70 @@
+#include "bufferpool.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct BufferPool {
+    std::mutex mutex;
+    std::unordered_map<size_t, std::vector<void *>> idle; // blocks by byte size
+    BufferPoolStats stats;
+};
+
+// Never destroyed, buffers may still be released while statics are torn down
+BufferPool &GetPool() {
+    static BufferPool *pool = new BufferPool;
+    return *pool;
+}
+
+thread_local uint64_t t_heapAllocations = 0;
+
+} // namespace
+
+void *AcquireBufferBlock(const size_t &bytes) {
+    BufferPool &pool = GetPool();
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stats.liveBytes += bytes;
+        auto blocks = pool.idle.find(bytes);
+        if (blocks != pool.idle.end() && !blocks->second.empty()) {
+            void *block = blocks->second.back();
+            blocks->second.pop_back();
+            pool.stats.idleBytes -= bytes;
+            pool.stats.reuses++;
+            return block;
+        }
+        pool.stats.heapAllocations++;
+    }
+    t_heapAllocations++;
+    return ::operator new(bytes, std::align_val_t(kBufferAlignment));
+}
+
+void ReleaseBufferBlock(void *block, const size_t &bytes) {
+    BufferPool &pool = GetPool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.idle[bytes].push_back(block);
+    pool.stats.liveBytes -= bytes;
+    pool.stats.idleBytes += bytes;
+}
+
+void TrimBufferPool() {
+    BufferPool &pool = GetPool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    for (auto &blocks : pool.idle) {
+        for (void *block : blocks.second) {
+            ::operator delete(block, std::align_val_t(kBufferAlignment));
+        }
+    }
+    pool.idle.clear();
+    pool.stats.idleBytes = 0;
+}
+
+BufferPoolStats GetBufferPoolStats() {
+    BufferPool &pool = GetPool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.stats;
+}
+
+uint64_t GetThreadBufferHeapAllocations() { return t_heapAllocations; }
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Alignment of every buffer allocated here, one cache line / one AVX-512 register
+const size_t kBufferAlignment = 64;
+
+// Recycling pool behind every Buffer allocation. Released blocks are kept per byte
+// size and handed out again for the next request of that size, whatever its element
+// type, so once a fixed-resolution sequence is past its first frames its buffers are
+// recycled and the heap is not touched. Idle blocks are only freed by
+// TrimBufferPool. Thread-safe.
+
+// kBufferAlignment-aligned block of bytes, idle or from the heap
+void *AcquireBufferBlock(const size_t &bytes);
+// Give a block of AcquireBufferBlock(bytes) back to the pool
+void ReleaseBufferBlock(void *block, const size_t &bytes);
+// Free all idle blocks
+void TrimBufferPool();
+
+struct BufferPoolStats {
+    uint64_t heapAllocations = 0; // requests that went to the heap
+    uint64_t reuses = 0; // requests served by an idle block
+    size_t liveBytes = 0; // handed out
+    size_t idleBytes = 0; // waiting for reuse
+};
+
+BufferPoolStats GetBufferPoolStats();
+// Heap allocations of the pool made by the calling thread so far, to attribute them
+// to one stage while other threads load frames
+uint64_t GetThreadBufferHeapAllocations();
+
+// Allocator drawing from the pool, for the control blocks of shared buffers
+template <typename T>
+struct BufferPoolAllocator {
+    typedef T value_type;
+
+    BufferPoolAllocator() = default;
+    template <typename U>
+    BufferPoolAllocator(const BufferPoolAllocator<U> &) {}
+
+    T *allocate(const size_t &n) {
+        static_assert(alignof(T) <= kBufferAlignment,
+                      "blocks are kBufferAlignment-aligned");
+        return static_cast<T *>(AcquireBufferBlock(sizeof(T) * n));
+    }
+    void deallocate(T *p, const size_t &n) { ReleaseBufferBlock(p, sizeof(T) * n); }
+};
+
+template <typename T, typename U>
+inline bool operator==(const BufferPoolAllocator<T> &, const BufferPoolAllocator<U> &) {
+    return true;
+}
+template <typename T, typename U>
+inline bool operator!=(const BufferPoolAllocator<T> &, const BufferPoolAllocator<U> &) {
+    return false;
+}
@@ -15,3 +15,13 @@
             exit(-1);                                                                    \
         }                                                                                \
     } while (false)
+
+// CHECK in builds with DENOISE_DEBUG_CHECKS (the CMake Debug configuration), nothing
+// otherwise; for the bounds of the unchecked accessors of hot loops
+#ifdef DENOISE_DEBUG_CHECKS
+#define DCHECK(cond) CHECK(cond)
+#else
+#define DCHECK(cond)                                                                     \
+    do {                                                                                 \
+    } while (false)
+#endif
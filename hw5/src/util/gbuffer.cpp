@@ -0,0 +1,98 @@
+#include "gbuffer.h"
+
+PixelRays MakePixelRays(const Matrix4x4 &worldToScreen) {
+    // Rows x, y and w of the matrix: a pixel's ray lies in the planes x = sx * w and
+    // y = sy * w, so its direction is (a - sx c) x (b - sy c), affine in sx and sy.
+    // Scaled so that c . ray = 1, the depth along it is w. Evaluated in double.
+    const float(&m)[4][4] = worldToScreen.m;
+    double a[3] = {m[0][0], m[0][1], m[0][2]};
+    double b[3] = {m[1][0], m[1][1], m[1][2]};
+    double c[3] = {m[3][0], m[3][1], m[3][2]};
+    auto cross = [](const double u[3], const double v[3], double out[3]) {
+        out[0] = u[1] * v[2] - u[2] * v[1];
+        out[1] = u[2] * v[0] - u[0] * v[2];
+        out[2] = u[0] * v[1] - u[1] * v[0];
+    };
+    double ab[3], bc[3], ca[3];
+    cross(a, b, ab);
+    cross(b, c, bc);
+    cross(c, a, ca);
+    double det = c[0] * ab[0] + c[1] * ab[1] + c[2] * ab[2];
+    CHECK(det != 0.0); // no single center of projection, e.g. orthographic
+
+    PixelRays rays;
+    auto scaled = [&](const double v[3]) {
+        return Float3(v[0] / det, v[1] / det, v[2] / det);
+    };
+    rays.base = scaled(ab);
+    rays.dx = scaled(bc);
+    rays.dy = scaled(ca);
+    // Camera center, where x, y and w all vanish
+    double origin[3];
+    for (int i = 0; i < 3; i++) {
+        origin[i] = -(m[0][3] * bc[i] + m[1][3] * ca[i] + m[3][3] * ab[i]);
+    }
+    rays.origin = scaled(origin);
+    return rays;
+}
+
+bool FitsObjectIds(const Buffer2D<float> &id) {
+    int height = id.m_height;
+    int width = id.m_width;
+    bool fits = true;
+    #pragma omp parallel for reduction(&& : fits)
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            fits = fits && FitsObjectId(id(x, y));
+        }
+    }
+    return fits;
+}
+
+void EncodeObjectIds(const Buffer2D<float> &id, Buffer2D<uint16_t> &out) {
+    int height = id.m_height;
+    int width = id.m_width;
+    if (out.m_width != width || out.m_height != height) {
+        out = CreateBuffer2D<uint16_t>(width, height);
+    }
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            out(x, y) = EncodeObjectId(id(x, y));
+        }
+    }
+}
+
+CompactGBuffer EncodeCompactGBuffer(const PlanarBuffer2D<float> &normal,
+                                    const PlanarBuffer2D<float> &position,
+                                    const Buffer2D<float> &id,
+                                    const Matrix4x4 &worldToScreen) {
+    int height = id.m_height;
+    int width = id.m_width;
+    bool hasNormal = normal.m_width > 0;
+    bool hasPosition = position.m_width > 0;
+    CompactGBuffer gbuffer;
+    if (hasNormal) {
+        gbuffer.m_normal = CreateBuffer2D<uint32_t>(width, height);
+    }
+    if (hasPosition) {
+        gbuffer.m_depth = CreateBuffer2D<float>(width, height);
+    }
+    gbuffer.m_id = CreateBuffer2D<uint16_t>(width, height);
+    gbuffer.m_rays = MakePixelRays(worldToScreen);
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (hasNormal) {
+                gbuffer.m_normal(x, y) = EncodeOctahedral(normal(x, y));
+            }
+            if (hasPosition) {
+                gbuffer.m_depth(x, y) = LinearDepth(worldToScreen, position(x, y));
+            }
+            gbuffer.m_id(x, y) = EncodeObjectId(id(x, y));
+        }
+    }
+    return gbuffer;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+
+#include "planarbuffer.h"
+
+// Compact G-buffer encodings. Per pixel the full planes take 28 bytes (normal,
+// position, float ID); the compact ones take 10:
+//   normal    2 x snorm16 octahedral (Cigolle et al. 2014), 4 bytes
+//   position  linear depth (clip-space w), 4 bytes; world position is rebuilt from
+//             it and the camera ray through the pixel center
+//   object ID uint16, 2 bytes; frames with larger IDs are not compacted
+
+// Object ID of background pixels (ID < 0 in the full planes)
+const uint16_t kBackgroundId = 0xffff;
+
+// Whether a full-plane (float) ID has a uint16 encoding: background or below
+// kBackgroundId
+inline bool FitsObjectId(const float &id) { return static_cast<int>(id) < kBackgroundId; }
+
+// uint16 object ID of a full-plane (float) ID; IDs must be below kBackgroundId
+inline uint16_t EncodeObjectId(const float &id) {
+    int object = id;
+    CHECK(object < kBackgroundId);
+    return object < 0 ? kBackgroundId : static_cast<uint16_t>(object);
+}
+
+// Object ID of a uint16 ID, -1 for background
+inline int DecodeObjectId(const uint16_t &id) { return id == kBackgroundId ? -1 : id; }
+
+// Octahedral normal: x in the low, y in the high 16 bits, as snorm16. A zero vector
+// (background) is stored as -32768 twice, outside the snorm range, and decodes as
+// zero again.
+const uint32_t kZeroNormal = 0x80008000u;
+
+inline uint32_t EncodeOctahedral(const Float3 &n) {
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (sum == 0.f) {
+        return kZeroNormal;
+    }
+    float u = n.x / sum;
+    float v = n.y / sum;
+    if (n.z < 0.f) {
+        float fu = (1.f - std::fabs(v)) * (u >= 0.f ? 1.f : -1.f);
+        float fv = (1.f - std::fabs(u)) * (v >= 0.f ? 1.f : -1.f);
+        u = fu;
+        v = fv;
+    }
+    auto snorm = [](const float &f) {
+        float clamped = std::fmin(std::fmax(f, -1.f), 1.f);
+        return static_cast<uint16_t>(static_cast<int16_t>(std::round(clamped * 32767.f)));
+    };
+    return snorm(u) | (static_cast<uint32_t>(snorm(v)) << 16);
+}
+
+inline Float3 DecodeOctahedral(const uint32_t &bits) {
+    if (bits == kZeroNormal) {
+        return Float3(0.f);
+    }
+    float u = std::fmax(static_cast<int16_t>(bits & 0xffff) / 32767.f, -1.f);
+    float v = std::fmax(static_cast<int16_t>(bits >> 16) / 32767.f, -1.f);
+    float z = 1.f - std::fabs(u) - std::fabs(v);
+    float t = std::fmax(-z, 0.f);
+    u -= std::copysign(t, u);
+    v -= std::copysign(t, v);
+    return Normalize(Float3(u, v, z));
+}
+
+// Rays of a pinhole camera through screen position (sx, sy): the world position at
+// linear depth w is origin + w * (base + sx * dx + sy * dy). Unlike inverting the
+// world-to-screen matrix on a nonlinear screen-space depth, this keeps full float
+// precision far from the camera and needs no division.
+struct PixelRays {
+    Float3 origin, base, dx, dy;
+};
+
+// Rays of the camera of a perspective world-to-screen matrix
+PixelRays MakePixelRays(const Matrix4x4 &worldToScreen);
+
+// Linear depth of a world position: its clip-space w
+inline float LinearDepth(const Matrix4x4 &worldToScreen, const Float3 &p) {
+    const float(&m)[4][4] = worldToScreen.m;
+    return m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3];
+}
+
+// World position of the center of pixel (x, y) at linear depth
+inline Float3 ReconstructPosition(const PixelRays &rays, const int &x, const int &y,
+                                  const float &depth) {
+    Float3 ray = rays.base + rays.dx * (x + 0.5f) + rays.dy * (y + 0.5f);
+    return rays.origin + ray * depth;
+}
+
+struct CompactGBuffer {
+    Buffer2D<uint32_t> m_normal; // octahedral normals
+    Buffer2D<float> m_depth;     // linear depth
+    Buffer2D<uint16_t> m_id;     // object ID, kBackgroundId for background
+    PixelRays m_rays;            // camera rays of the frame
+};
+
+// Whether every ID of a full ID plane has a uint16 encoding
+bool FitsObjectIds(const Buffer2D<float> &id);
+
+// uint16 IDs of a full ID plane into out, which is (re)allocated unless it already
+// has the size of id
+void EncodeObjectIds(const Buffer2D<float> &id, Buffer2D<uint16_t> &out);
+
+// Encode the full normal, position and ID planes. Depth is taken from the positions
+// rather than a depth channel, so that rebuilding a position at the pixel center
+// lands on the surface it came from. Object IDs must be below kBackgroundId. Empty
+// normal or position planes give empty compact ones.
+CompactGBuffer EncodeCompactGBuffer(const PlanarBuffer2D<float> &normal,
+                                    const PlanarBuffer2D<float> &position,
+                                    const Buffer2D<float> &id,
+                                    const Matrix4x4 &worldToScreen);
+
+// Normal and world position of a pixel, from views of the full planes (normals in T)
+// or of a compact G-buffer, for code templated on the encoding. Reads are unchecked:
+// planes that were not loaded must not be read.
+template <typename T>
+struct PlanarGeometry {
+    PlanarGeometry(const PlanarBuffer2D<T> &normal, const PlanarBuffer2D<float> &position)
+        : normal(normal.View()), position(position.View()) {}
+
+    Float3 Normal(const int &x, const int &y) const { return normal(x, y); }
+    Float3 Position(const int &x, const int &y) const { return position(x, y); }
+
+    PlanarView2D<const T> normal;
+    PlanarView2D<const float> position;
+};
+
+struct CompactGeometry {
+    explicit CompactGeometry(const CompactGBuffer &gbuffer)
+        : normal(gbuffer.m_normal.View()), depth(gbuffer.m_depth.View()),
+          rays(gbuffer.m_rays) {}
+
+    Float3 Normal(const int &x, const int &y) const {
+        return DecodeOctahedral(normal(x, y));
+    }
+    Float3 Position(const int &x, const int &y) const {
+        return ReconstructPosition(rays, x, y, depth(x, y));
+    }
+
+    BufferView2D<const uint32_t> normal;
+    BufferView2D<const float> depth;
+    PixelRays rays;
+};
+
+// Unchecked object IDs (-1 for background) of a full or a compact ID plane, whichever
+// is not empty
+struct ObjectIdView {
+    ObjectIdView(const Buffer2D<float> &id, const Buffer2D<uint16_t> &compactId)
+        : id(id.View()), compactId(compactId.View()) {}
+
+    int operator()(const int &x, const int &y) const {
+        if (compactId.m_data != nullptr) {
+            return DecodeObjectId(compactId(x, y));
+        }
+        return id(x, y);
+    }
+
+    BufferView2D<const float> id;
+    BufferView2D<const uint16_t> compactId;
+};
@@ -0,0 +1,121 @@
+#include "halfconvert.h"
+
+#include <cstring>
+
+#include "simdutil.h"
+
+// Bit manipulation after F. Giesen's float_to_half_fast3_rtne / half_to_float
+Half FloatToHalf(const float &v) {
+    uint32_t f;
+    std::memcpy(&f, &v, sizeof(f));
+    uint32_t sign = (f >> 16) & 0x8000;
+    f &= 0x7fffffff;
+
+    uint32_t h;
+    if (f >= 0x47800000) { // 2^16 and up, inf and NaN
+        h = f > 0x7f800000 ? 0x7e00 : 0x7c00;
+    } else if (f < 0x38800000) { // below 2^-14, half denormal or zero
+        // Adding 0.5 lines the denormal mantissa up with the float one, and the FPU
+        // rounds it to nearest even
+        float magic, shifted;
+        uint32_t magicBits = 126u << 23;
+        std::memcpy(&magic, &magicBits, sizeof(magic));
+        std::memcpy(&shifted, &f, sizeof(shifted));
+        shifted += magic;
+        std::memcpy(&h, &shifted, sizeof(h));
+        h -= magicBits;
+    } else {
+        uint32_t mantOdd = (f >> 13) & 1;
+        f += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mantOdd;
+        h = f >> 13;
+    }
+    return Half{static_cast<uint16_t>(h | sign)};
+}
+
+float HalfToFloat(const Half &h) {
+    const uint32_t shiftedExp = 0x7c00u << 13;
+    uint32_t f = (h.bits & 0x7fffu) << 13;
+    uint32_t exp = f & shiftedExp;
+    f += static_cast<uint32_t>(127 - 15) << 23;
+
+    float v;
+    if (exp == shiftedExp) { // inf or NaN
+        f += static_cast<uint32_t>(128 - 16) << 23;
+        std::memcpy(&v, &f, sizeof(v));
+    } else if (exp == 0) { // zero or denormal, renormalized by the FPU
+        f += 1u << 23;
+        float magic;
+        uint32_t magicBits = 113u << 23;
+        std::memcpy(&magic, &magicBits, sizeof(magic));
+        std::memcpy(&v, &f, sizeof(v));
+        v -= magic;
+    } else {
+        std::memcpy(&v, &f, sizeof(v));
+    }
+
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    bits |= static_cast<uint32_t>(h.bits & 0x8000u) << 16;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+enum class HalfConvertLevel { Scalar, F16C, AVX512 };
+
+static HalfConvertLevel GetHalfConvertLevel() {
+    static const HalfConvertLevel level =
+        DetectSimdLevel() >= SimdLevel::AVX512 ? HalfConvertLevel::AVX512
+        : CpuSupportsF16C()                    ? HalfConvertLevel::F16C
+                                               : HalfConvertLevel::Scalar;
+    return level;
+}
+
+const char *HalfConvertLevelName() {
+    switch (GetHalfConvertLevel()) {
+    case HalfConvertLevel::AVX512:
+        return "AVX-512";
+    case HalfConvertLevel::F16C:
+        return "F16C";
+    case HalfConvertLevel::Scalar:
+    default:
+        return "Scalar";
+    }
+}
+
+void FloatToHalf(const float *src, Half *dst, const size_t &count) {
+    size_t done = 0;
+#if SIMD_X86
+    switch (GetHalfConvertLevel()) {
+    case HalfConvertLevel::AVX512:
+        done = FloatToHalfAVX512(src, dst, count);
+        break;
+    case HalfConvertLevel::F16C:
+        done = FloatToHalfF16C(src, dst, count);
+        break;
+    default:
+        break;
+    }
+#endif
+    for (size_t i = done; i < count; i++) {
+        dst[i] = FloatToHalf(src[i]);
+    }
+}
+
+void HalfToFloat(const Half *src, float *dst, const size_t &count) {
+    size_t done = 0;
+#if SIMD_X86
+    switch (GetHalfConvertLevel()) {
+    case HalfConvertLevel::AVX512:
+        done = HalfToFloatAVX512(src, dst, count);
+        break;
+    case HalfConvertLevel::F16C:
+        done = HalfToFloatF16C(src, dst, count);
+        break;
+    default:
+        break;
+    }
+#endif
+    for (size_t i = done; i < count; i++) {
+        dst[i] = HalfToFloat(src[i]);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// IEEE 754 binary16, a distinct type so Buffer2D<Half> is not mistaken for integers
+struct Half {
+    uint16_t bits;
+};
+
+// Round to nearest even; overflow gives infinity, NaN stays a (quiet) NaN
+Half FloatToHalf(const float &v);
+float HalfToFloat(const Half &h);
+
+// Convert count values, 8 or 16 per instruction with F16C or AVX-512 when the CPU
+// has them (see HalfConvertLevelName). Results match the scalar functions bit for
+// bit, except for the payload of NaNs.
+void FloatToHalf(const float *src, Half *dst, const size_t &count);
+void HalfToFloat(const Half *src, float *dst, const size_t &count);
+const char *HalfConvertLevelName();
+
+// Per-ISA kernels (halfconvert_*.cpp), converting the leading multiple of 8 / 16
+// values and returning how many that was. Only used by the dispatch above.
+size_t FloatToHalfF16C(const float *src, Half *dst, const size_t &count);
+size_t HalfToFloatF16C(const Half *src, float *dst, const size_t &count);
+size_t FloatToHalfAVX512(const float *src, Half *dst, const size_t &count);
+size_t HalfToFloatAVX512(const Half *src, float *dst, const size_t &count);
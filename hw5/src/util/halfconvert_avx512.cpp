@@ -0,0 +1,31 @@
+#include "simdutil.h"
+
+#if SIMD_X86
+// GCC 12's AVX-512 headers set their undefined registers from themselves (__Y = __Y),
+// which -Wmaybe-uninitialized reports wherever such an intrinsic is inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+
+#include "halfconvert.h"
+
+size_t FloatToHalfAVX512(const float *src, Half *dst, const size_t &count) {
+    size_t n = count / 16 * 16;
+    for (size_t i = 0; i < n; i += 16) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), h);
+    }
+    return n;
+}
+
+size_t HalfToFloatAVX512(const Half *src, float *dst, const size_t &count) {
+    size_t n = count / 16 * 16;
+    for (size_t i = 0; i < n; i += 16) {
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+    }
+    return n;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#include "simdutil.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+
+#include "halfconvert.h"
+
+size_t FloatToHalfF16C(const float *src, Half *dst, const size_t &count) {
+    size_t n = count / 8 * 8;
+    for (size_t i = 0; i < n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), h);
+    }
+    return n;
+}
+
+size_t HalfToFloatF16C(const Half *src, float *dst, const size_t &count) {
+    size_t n = count / 8 * 8;
+    for (size_t i = 0; i < n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    return n;
+}
+
+#endif
@@ -1,51 +1,55 @@
 #include "image.h"
 
 Buffer2D<float> ReadFloatImage(const std::string &filename) {
-    int width, height;
-    float *buffer = ReadImage(filename, width, height, 1);
-    CHECK(buffer != nullptr);
-    return Buffer2D<float>(buffer, width, height);
+    return ReadFloatImageLayer(filename, "");
 }
 
 Buffer2D<float> ReadFloatImageLayer(const std::string &filename,
                                     const std::string &layername) {
     int width, height;
-    float *buffer = ReadImageLayer(filename, layername, width, height, 1);
-    CHECK(buffer != nullptr);
-    return Buffer2D<float>(buffer, width, height);
+    std::vector<std::shared_ptr<float[]>> planes;
+    CHECK(ReadImageLayerPlanes(filename, layername, 1, width, height, planes));
+    return Buffer2D<float>(planes[0], width, height);
 }
 
-Buffer2D<Float3> ReadFloat3Image(const std::string &filename) {
+std::vector<Buffer2D<float>>
+ReadFloatImageChannels(const std::string &filename,
+                       const std::vector<std::string> &names) {
     int width, height;
-    float *_buffer = ReadImage(filename, width, height, 3);
-    CHECK(_buffer != nullptr);
-    Float3 *buffer = new Float3[width * height];
-    for (int i = 0; i < width * height; i++) {
-        buffer[i] = Float3(_buffer[i * 3 + 0], _buffer[i * 3 + 1], _buffer[i * 3 + 2]);
+    std::vector<std::shared_ptr<float[]>> planes;
+    CHECK(ReadImageChannels(filename, names, width, height, planes));
+    std::vector<Buffer2D<float>> buffers;
+    for (const std::shared_ptr<float[]> &plane : planes) {
+        CHECK(plane != nullptr);
+        buffers.push_back(Buffer2D<float>(plane, width, height));
     }
-    delete[] _buffer;
-    return Buffer2D<Float3>(buffer, width, height);
+    return buffers;
+}
+
+PlanarBuffer2D<float> ReadFloat3Image(const std::string &filename) {
+    return ReadFloat3ImageLayer(filename, "");
 }
 
-Buffer2D<Float3> ReadFloat3ImageLayer(const std::string &filename,
-                                      const std::string &layername) {
+PlanarBuffer2D<float> ReadFloat3ImageLayer(const std::string &filename,
+                                           const std::string &layername) {
     int width, height;
-    float *_buffer = ReadImageLayer(filename, layername, width, height, 3);
-    CHECK(_buffer != nullptr);
-    Float3 *buffer = new Float3[width * height];
-    for (int i = 0; i < width * height; i++) {
-        buffer[i] = Float3(_buffer[i * 3 + 0], _buffer[i * 3 + 1], _buffer[i * 3 + 2]);
-    }
-    delete[] _buffer;
-    return Buffer2D<Float3>(buffer, width, height);
+    std::vector<std::shared_ptr<float[]>> planes;
+    CHECK(ReadImageLayerPlanes(filename, layername, 3, width, height, planes));
+    return PlanarBuffer2D<float>(Buffer2D<float>(planes[0], width, height),
+                                 Buffer2D<float>(planes[1], width, height),
+                                 Buffer2D<float>(planes[2], width, height));
 }
 
-void WriteFloatImage(const Buffer2D<float> &imageBuffer, const std::string &filename) {
+void WriteFloatImage(const Buffer2D<float> &imageBuffer, const std::string &filename,
+                     const ImageWriteOptions &options) {
     WriteImage(filename, imageBuffer.m_width, imageBuffer.m_height, 1,
-               (float *)imageBuffer.m_buffer.get());
+               (float *)imageBuffer.m_buffer.get(), options);
 }
 
-void WriteFloat3Image(const Buffer2D<Float3> &imageBuffer, const std::string &filename) {
-    WriteImage(filename, imageBuffer.m_width, imageBuffer.m_height, 3,
-               (float *)imageBuffer.m_buffer.get());
+void WriteFloat3Image(const PlanarBuffer2D<float> &imageBuffer,
+                      const std::string &filename, const ImageWriteOptions &options) {
+    const float *planes[3] = {imageBuffer.Plane(0), imageBuffer.Plane(1),
+                              imageBuffer.Plane(2)};
+    WriteImagePlanes(filename, imageBuffer.m_width, imageBuffer.m_height, 3, planes,
+                     options);
 }
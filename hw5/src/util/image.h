@@ -3,12 +3,20 @@
 #include "buffer.h"
 #include "imageutil.h"
 #include "mathutil.h"
+#include "planarbuffer.h"
 
 Buffer2D<float> ReadFloatImage(const std::string &filename);
 Buffer2D<float> ReadFloatImageLayer(const std::string &filename,
                                     const std::string &layername);
-Buffer2D<Float3> ReadFloat3Image(const std::string &filename);
-Buffer2D<Float3> ReadFloat3ImageLayer(const std::string &filename,
-                                      const std::string &layername);
-void WriteFloatImage(const Buffer2D<float> &imageBuffer, const std::string &filename);
-void WriteFloat3Image(const Buffer2D<Float3> &imageBuffer, const std::string &filename);
\ No newline at end of file
+// Channels of one EXR file (see ReadImageChannels), all of which must exist
+std::vector<Buffer2D<float>>
+ReadFloatImageChannels(const std::string &filename,
+                       const std::vector<std::string> &names);
+PlanarBuffer2D<float> ReadFloat3Image(const std::string &filename);
+PlanarBuffer2D<float> ReadFloat3ImageLayer(const std::string &filename,
+                                           const std::string &layername);
+void WriteFloatImage(const Buffer2D<float> &imageBuffer, const std::string &filename,
+                     const ImageWriteOptions &options = ImageWriteOptions());
+void WriteFloat3Image(const PlanarBuffer2D<float> &imageBuffer,
+                      const std::string &filename,
+                      const ImageWriteOptions &options = ImageWriteOptions());
\ No newline at end of file
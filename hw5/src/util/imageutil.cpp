@@ -1,9 +1,57 @@
 #include "imageutil.h"
+#include "buffer.h"
 #include "common.h"
+#include "halfconvert.h"
+#include "trace.h"
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Chunks are (de)compressed in parallel: by OpenMP when the build has it, so the
+// thread count follows SetImageThreads, by tinyexr's own threads otherwise (one per
+// hardware thread, tinyexr takes no count)
+#ifdef _OPENMP
+#define TINYEXR_USE_OPENMP 1
+#else
+#define TINYEXR_USE_THREAD 1
+#endif
 #define TINYEXR_IMPLEMENTATION
 #include "tinyexr/tinyexr.h"
 
+static std::atomic<int> g_imageThreads(0);
+
+void SetImageThreads(const int &threads) { g_imageThreads = std::max(threads, 0); }
+
+int GetImageThreads() { return g_imageThreads; }
+
+// Limits the OpenMP threads of the calling thread to the image thread count while
+// in scope
+class ImageThreadScope {
+  public:
+    ImageThreadScope() {
+#ifdef _OPENMP
+        m_previous = omp_get_max_threads();
+        if (g_imageThreads > 0) {
+            omp_set_num_threads(g_imageThreads);
+        }
+#endif
+    }
+    ~ImageThreadScope() {
+#ifdef _OPENMP
+        omp_set_num_threads(m_previous);
+#endif
+    }
+
+  private:
+    int m_previous = 0;
+};
+
 std::string GetExtension(const std::string &s) {
     size_t pos = s.rfind('.');
     CHECK(pos != std::string::npos);
@@ -11,75 +59,215 @@ std::string GetExtension(const std::string &s) {
     return ext;
 }
 
-float *ReadImage(const std::string &filename, int &width, int &height,
-                 const int &channel) {
-    CHECK(channel == 1 || channel == 3);
-    std::string ext = GetExtension(filename);
-    CHECK(ext == "exr");
+// Decode an EXR file from a single read and header parse. select maps the header to
+// the channel index behind every output plane (-1 if missing). Only those channels
+// are converted (or copied, if float) into pooled, aligned planes, each once however
+// many outputs share it. tinyexr still decompresses every channel into its own
+// malloc'd planes first, so this is one extra pass, not a decode in place: it has no
+// API to decode a subset of channels or to decode into caller buffers.
+static bool DecodeImageChannels(
+    const std::string &filename,
+    const std::function<std::vector<int>(const EXRHeader &)> &select, int &width,
+    int &height, std::vector<std::shared_ptr<float[]>> &planes) {
+    CHECK(GetExtension(filename) == "exr");
 
-    float *out; // width * height * RGBA
-    const char *err = nullptr;
-    int ret = LoadEXR(&out, &width, &height, filename.c_str(), &err);
-    float *buffer = new float[width * height * channel];
+    std::vector<unsigned char> file;
+    {
+        TRACE_SCOPE("ReadExrFile");
+        std::ifstream is(filename, std::ios::binary | std::ios::ate);
+        if (!is.is_open()) {
+            return false;
+        }
+        file.resize(static_cast<size_t>(is.tellg()));
+        is.seekg(0);
+        is.read(reinterpret_cast<char *>(file.data()), file.size());
+        is.close();
+    }
 
+    const char *err = nullptr;
+    EXRVersion version;
+    EXRHeader header;
+    InitEXRHeader(&header);
+    EXRImage image;
+    InitEXRImage(&image);
+    std::vector<int> source;
+    int ret = ParseEXRVersionFromMemory(&version, file.data(), file.size());
+    if (ret == TINYEXR_SUCCESS) {
+        ret = ParseEXRHeaderFromMemory(&header, &version, file.data(), file.size(), &err);
+    }
+    if (ret == TINYEXR_SUCCESS) {
+        // Half channels are left half by tinyexr and converted with SIMD below. The
+        // ones nobody asked for are decompressed too (tinyexr can't skip them) but
+        // never converted
+        source = select(header);
+        TRACE_SCOPE("DecodeExr");
+        ImageThreadScope threads;
+        ret = LoadEXRImageFromMemory(&image, &header, file.data(), file.size(), &err);
+        if (ret != TINYEXR_SUCCESS) {
+            FreeEXRHeader(&header);
+        }
+    }
     if (ret != TINYEXR_SUCCESS) {
         if (err) {
             fprintf(stderr, "ERR : %s\n", err);
             FreeEXRErrorMessage(err); // release memory of error message.
-            delete[] buffer;
-            buffer = nullptr;
         }
-    } else {
-        for (int i = 0; i < width * height; i++) {
-            for (int j = 0; j < channel; j++) {
-                buffer[i * channel + j] = out[i * 4 + j];
+        return false;
+    }
+
+    width = image.width;
+    height = image.height;
+    std::vector<std::shared_ptr<float[]>> decoded(header.num_channels);
+    auto channelPlane = [&](const int &c) {
+        if (decoded[c] != nullptr) {
+            return decoded[c];
+        }
+        int pixelType = header.pixel_types[c];
+        // Float channels are copied as well: tinyexr's malloc'd planes are neither
+        // kBufferAlignment-aligned nor pooled
+        std::shared_ptr<float[]> plane = AllocateBuffer<float>(width * height);
+        // Convert a row of cols pixels from src into the plane at (x0, y)
+        size_t pixelSize =
+            pixelType == TINYEXR_PIXELTYPE_HALF ? sizeof(Half) : sizeof(float);
+        auto copyRow = [&](const unsigned char *src, const int &x0, const int &y,
+                           const int &cols) {
+            float *dst = plane.get() + y * width + x0;
+            if (pixelType == TINYEXR_PIXELTYPE_HALF) {
+                HalfToFloat(reinterpret_cast<const Half *>(src), dst, cols);
+            } else if (pixelType == TINYEXR_PIXELTYPE_UINT) {
+                const unsigned int *row = reinterpret_cast<const unsigned int *>(src);
+                for (int x = 0; x < cols; x++) {
+                    dst[x] = static_cast<float>(row[x]);
+                }
+            } else {
+                std::memcpy(dst, src, sizeof(float) * cols);
             }
+        };
+        if (image.tiles == nullptr) {
+            // Scanline planes are contiguous, convert them in one go
+            copyRow(image.images[c], 0, 0, width * height);
+        } else {
+            int tileWidth = header.tile_size_x, tileHeight = header.tile_size_y;
+            for (int t = 0; t < image.num_tiles; t++) {
+                const EXRTile &tile = image.tiles[t];
+                // Tiles are stored at full tile size, the edge ones only partly used
+                for (int y = 0; y < tile.height; y++) {
+                    copyRow(tile.images[c] + pixelSize * y * tileWidth,
+                            tile.offset_x * tileWidth, tile.offset_y * tileHeight + y,
+                            tile.width);
+                }
+            }
+        }
+        decoded[c] = plane;
+        return decoded[c];
+    };
+
+    TRACE_SCOPE("ConvertExrChannels");
+    planes.assign(source.size(), nullptr);
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] >= 0) {
+            planes[i] = channelPlane(source[i]);
         }
-        delete[] out; // release memory of image data
     }
-    return buffer;
-}
 
-float *ReadImageLayer(const std::string &filename, const std::string &layername,
-                      int &width, int &height, const int &channel) {
-    CHECK(channel == 1 || channel == 3);
-    std::string ext = GetExtension(filename);
-    CHECK(ext == "exr");
+    FreeEXRImage(&image);
+    FreeEXRHeader(&header);
+    return true;
+}
 
-    float *out; // width * height * RGBA
-    const char *err = nullptr;
-    int ret = LoadEXRWithLayer(&out, &width, &height, filename.c_str(), layername.c_str(),
-                               &err);
-    float *buffer = new float[width * height * channel];
+static int FindChannel(const EXRHeader &header, const std::string &name) {
+    for (int c = 0; c < header.num_channels; c++) {
+        if (name == header.channels[c].name) {
+            return c;
+        }
+    }
+    return -1;
+}
 
-    if (ret != TINYEXR_SUCCESS) {
-        if (err) {
-            fprintf(stderr, "ERR : %s\n", err);
-            FreeEXRErrorMessage(err); // release memory of error message.
-            delete[] buffer;
-            buffer = nullptr;
+bool ReadImageLayerPlanes(const std::string &filename, const std::string &layername,
+                          const int &channel, int &width, int &height,
+                          std::vector<std::shared_ptr<float[]>> &planes) {
+    CHECK(channel == 1 || channel == 3);
+    auto select = [&](const EXRHeader &header) {
+        std::string prefix = layername.empty() ? "" : layername + ".";
+        const char *names[3] = {"R", "G", "B"};
+        std::vector<int> source(channel, -1);
+        for (int i = 0; i < channel; i++) {
+            source[i] = FindChannel(header, prefix + names[i]);
         }
-    } else {
-        for (int i = 0; i < width * height; i++) {
-            for (int j = 0; j < channel; j++) {
-                buffer[i * channel + j] = out[i * 4 + j];
+        // A single-channel layer (such as Y) supplies every requested channel
+        if (source[0] < 0) {
+            int count = 0, only = -1;
+            for (int c = 0; c < header.num_channels; c++) {
+                std::string name = header.channels[c].name;
+                if (name.compare(0, prefix.size(), prefix) == 0 &&
+                    name.find('.', prefix.size()) == std::string::npos) {
+                    count++;
+                    only = c;
+                }
+            }
+            if (count == 1) {
+                source.assign(channel, only);
             }
         }
-        delete[] out; // release memory of image data
+        return source;
+    };
+    if (!DecodeImageChannels(filename, select, width, height, planes)) {
+        return false;
+    }
+    for (const std::shared_ptr<float[]> &plane : planes) {
+        if (plane == nullptr) {
+            fprintf(stderr, "ERR : %s has no %d-channel layer \"%s\"\n", filename.c_str(),
+                    channel, layername.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Interleave the planes of a layer into a new[] buffer
+static float *ReadInterleaved(const std::string &filename, const std::string &layername,
+                              int &width, int &height, const int &channel) {
+    std::vector<std::shared_ptr<float[]>> planes;
+    if (!ReadImageLayerPlanes(filename, layername, channel, width, height, planes)) {
+        return nullptr;
+    }
+    float *buffer = new float[width * height * channel];
+    for (int i = 0; i < width * height; i++) {
+        for (int j = 0; j < channel; j++) {
+            buffer[i * channel + j] = planes[j][i];
+        }
     }
     return buffer;
 }
 
-bool WriteImage(const std::string &filename, const int &width, const int &height,
-                const int &channel, const float *buffer) {
-    CHECK(channel == 1 || channel == 3);
-    EXRHeader header;
-    InitEXRHeader(&header);
+float *ReadImage(const std::string &filename, int &width, int &height,
+                 const int &channel) {
+    return ReadInterleaved(filename, "", width, height, channel);
+}
 
-    EXRImage image;
-    InitEXRImage(&image);
+float *ReadImageLayer(const std::string &filename, const std::string &layername,
+                      int &width, int &height, const int &channel) {
+    return ReadInterleaved(filename, layername, width, height, channel);
+}
 
-    image.num_channels = channel;
+bool ReadImageChannels(const std::string &filename, const std::vector<std::string> &names,
+                       int &width, int &height,
+                       std::vector<std::shared_ptr<float[]>> &planes) {
+    auto select = [&](const EXRHeader &header) {
+        std::vector<int> source;
+        for (const std::string &name : names) {
+            source.push_back(FindChannel(header, name));
+        }
+        return source;
+    };
+    return DecodeImageChannels(filename, select, width, height, planes);
+}
+
+bool WriteImage(const std::string &filename, const int &width, const int &height,
+                const int &channel, const float *buffer,
+                const ImageWriteOptions &options) {
+    CHECK(channel == 1 || channel == 3);
     std::vector<float> images[3];
     for (int i = 0; i < channel; i++) {
         images[i].resize(width * height);
@@ -92,18 +280,53 @@ bool WriteImage(const std::string &filename, const int &width, const int &height
         }
     }
 
-    float *image_ptr[3];
+    const float *planes[3] = {nullptr, nullptr, nullptr};
+    for (int i = 0; i < channel; i++) {
+        planes[i] = images[i].data();
+    }
+    return WriteImagePlanes(filename, width, height, channel, planes, options);
+}
+
+bool WriteImagePlanes(const std::string &filename, const int &width, const int &height,
+                      const int &channel, const float *const *planes,
+                      const ImageWriteOptions &options) {
+    TRACE_SCOPE("EncodeExr");
+    CHECK(channel == 1 || channel == 3);
+    EXRHeader header;
+    InitEXRHeader(&header);
+
+    EXRImage image;
+    InitEXRImage(&image);
+
+    image.num_channels = channel;
+
+    // Half output is converted here with SIMD and handed to tinyexr as half
+    std::vector<Half> halfPlanes[3];
+    const void *channelPlanes[3] = {planes[0], nullptr, nullptr};
+    if (channel == 3) {
+        channelPlanes[1] = planes[1];
+        channelPlanes[2] = planes[2];
+    }
+    if (options.halfFloat) {
+        for (int i = 0; i < channel; i++) {
+            halfPlanes[i].resize(static_cast<size_t>(width) * height);
+            FloatToHalf(planes[i], halfPlanes[i].data(), halfPlanes[i].size());
+            channelPlanes[i] = halfPlanes[i].data();
+        }
+    }
+
+    unsigned char *image_ptr[3];
     if (channel == 3) {
-        image_ptr[0] = &(images[2].at(0)); // B
-        image_ptr[1] = &(images[1].at(0)); // G
-        image_ptr[2] = &(images[0].at(0)); // R
+        image_ptr[0] = (unsigned char *)channelPlanes[2]; // B
+        image_ptr[1] = (unsigned char *)channelPlanes[1]; // G
+        image_ptr[2] = (unsigned char *)channelPlanes[0]; // R
     } else if (channel == 1) {
-        image_ptr[0] = &(images[0].at(0)); // Y
+        image_ptr[0] = (unsigned char *)channelPlanes[0]; // Y
         image_ptr[1] = nullptr;
         image_ptr[2] = nullptr;
     }
 
-    image.images = (unsigned char **)image_ptr;
+    image.images = image_ptr;
     image.width = width;
     image.height = height;
 
@@ -127,13 +350,34 @@ bool WriteImage(const std::string &filename, const int &width, const int &height
     header.pixel_types = (int *)malloc(sizeof(int) * header.num_channels);
     header.requested_pixel_types = (int *)malloc(sizeof(int) * header.num_channels);
     for (int i = 0; i < header.num_channels; i++) {
-        header.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT; // pixel type of input image
-        header.requested_pixel_types[i] =
-            TINYEXR_PIXELTYPE_HALF; // pixel type of output image to be
-                                    // stored in .EXR
+        int pixelType =
+            options.halfFloat ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT;
+        header.pixel_types[i] = pixelType;           // pixel type of input image
+        header.requested_pixel_types[i] = pixelType; // pixel type of output image to be
+                                                     // stored in .EXR
+    }
+
+    switch (options.compression) {
+    case ImageCompression::RLE:
+        header.compression_type = TINYEXR_COMPRESSIONTYPE_RLE;
+        break;
+    case ImageCompression::ZIPS:
+        header.compression_type = TINYEXR_COMPRESSIONTYPE_ZIPS;
+        break;
+    case ImageCompression::ZIP:
+        header.compression_type = TINYEXR_COMPRESSIONTYPE_ZIP;
+        break;
+    case ImageCompression::PIZ:
+        header.compression_type = TINYEXR_COMPRESSIONTYPE_PIZ;
+        break;
+    case ImageCompression::None:
+    default:
+        header.compression_type = TINYEXR_COMPRESSIONTYPE_NONE;
+        break;
     }
 
     const char *err = nullptr;
+    ImageThreadScope threads;
     int ret = SaveEXRImageToFile(&image, &header, filename.c_str(), &err);
     if (ret != TINYEXR_SUCCESS) {
         fprintf(stderr, "Save EXR err: %s\n", err);
@@ -1,6 +1,22 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
+
+enum class ImageCompression { None, RLE, ZIPS, ZIP, PIZ };
+
+// How images are stored on write; the defaults match what WriteImage always did
+struct ImageWriteOptions {
+    ImageCompression compression = ImageCompression::None;
+    bool halfFloat = true; // half or full float pixels
+};
+
+// Threads each EXR read or write splits its chunks over, 0 for all of them. Frames
+// read and written concurrently each get this many. Only applies to OpenMP builds;
+// without OpenMP, tinyexr always starts one thread per hardware thread.
+void SetImageThreads(const int &threads);
+int GetImageThreads();
 
 float *ReadImage(const std::string &filename, int &width, int &height,
                  const int &channel);
@@ -8,5 +24,25 @@ float *ReadImage(const std::string &filename, int &width, int &height,
 float *ReadImageLayer(const std::string &filename, const std::string &layername,
                       int &width, int &height, const int &channel);
 
+// Decode channels R, G, B (channel == 3) or R (channel == 1) of a layer ("" for the
+// default one) straight into planes of width * height floats, without an RGBA copy.
+// A layer with a single channel (such as Y) supplies all of them, as LoadEXR does.
+bool ReadImageLayerPlanes(const std::string &filename, const std::string &layername,
+                          const int &channel, int &width, int &height,
+                          std::vector<std::shared_ptr<float[]>> &planes);
+
+// Decode the given channels (full names such as "beauty.R") of an EXR file, reading
+// the file and parsing its header once. planes[i] receives channel names[i] as
+// width * height floats, or nullptr if the file has no such channel.
+bool ReadImageChannels(const std::string &filename, const std::vector<std::string> &names,
+                       int &width, int &height,
+                       std::vector<std::shared_ptr<float[]>> &planes);
+
 bool WriteImage(const std::string &filename, const int &width, const int &height,
-                const int &channel, const float *buffer);
\ No newline at end of file
+                const int &channel, const float *buffer,
+                const ImageWriteOptions &options = ImageWriteOptions());
+
+// Same as WriteImage, but takes one plane per channel instead of interleaved data
+bool WriteImagePlanes(const std::string &filename, const int &width, const int &height,
+                      const int &channel, const float *const *planes,
+                      const ImageWriteOptions &options = ImageWriteOptions());
\ No newline at end of file
@@ -103,6 +103,36 @@ Matrix4x4 Inverse(const Matrix4x4 &mat) {
     return Matrix4x4(inv) / det;
 }
 
+// Only valid if mat.IsAffine(): inverse of [A t; 0 1] is [A^-1 -A^-1*t; 0 1]
+Matrix4x4 InverseAffine(const Matrix4x4 &mat) {
+    float inv[4][4];
+    inv[0][0] = mat.m[1][1] * mat.m[2][2] - mat.m[1][2] * mat.m[2][1];
+    inv[0][1] = mat.m[0][2] * mat.m[2][1] - mat.m[0][1] * mat.m[2][2];
+    inv[0][2] = mat.m[0][1] * mat.m[1][2] - mat.m[0][2] * mat.m[1][1];
+    inv[1][0] = mat.m[1][2] * mat.m[2][0] - mat.m[1][0] * mat.m[2][2];
+    inv[1][1] = mat.m[0][0] * mat.m[2][2] - mat.m[0][2] * mat.m[2][0];
+    inv[1][2] = mat.m[0][2] * mat.m[1][0] - mat.m[0][0] * mat.m[1][2];
+    inv[2][0] = mat.m[1][0] * mat.m[2][1] - mat.m[1][1] * mat.m[2][0];
+    inv[2][1] = mat.m[0][1] * mat.m[2][0] - mat.m[0][0] * mat.m[2][1];
+    inv[2][2] = mat.m[0][0] * mat.m[1][1] - mat.m[0][1] * mat.m[1][0];
+    float det = mat.m[0][0] * inv[0][0] + mat.m[0][1] * inv[1][0] +
+                mat.m[0][2] * inv[2][0];
+    CHECK(det != 0);
+    float invDet = 1.f / det;
+    for (uint32_t i = 0; i < 3; i++) {
+        for (uint32_t j = 0; j < 3; j++) {
+            inv[i][j] *= invDet;
+        }
+    }
+    for (uint32_t i = 0; i < 3; i++) {
+        inv[i][3] = -(inv[i][0] * mat.m[0][3] + inv[i][1] * mat.m[1][3] +
+                      inv[i][2] * mat.m[2][3]);
+    }
+    inv[3][0] = inv[3][1] = inv[3][2] = 0;
+    inv[3][3] = 1;
+    return Matrix4x4(inv);
+}
+
 Matrix4x4 Transpose(const Matrix4x4 &mat) {
     float m[4][4];
     for (uint32_t i = 0; i < 4; i++) {
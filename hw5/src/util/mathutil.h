@@ -149,6 +149,10 @@ class Matrix4x4 {
         return ret;
     }
     Float3 operator()(const Float3 &p, const Float3::EType &type) const;
+    // Bottom row is exactly (0, 0, 0, 1)
+    bool IsAffine() const {
+        return m[3][0] == 0 && m[3][1] == 0 && m[3][2] == 0 && m[3][3] == 1;
+    }
 
     float m[4][4];
 
@@ -166,5 +170,6 @@ class Matrix4x4 {
     }
 
     friend Matrix4x4 Inverse(const Matrix4x4 &mat);
+    friend Matrix4x4 InverseAffine(const Matrix4x4 &mat);
     friend Matrix4x4 Transpose(const Matrix4x4 &mat);
 };
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "perfcounters.h"
+
+#include <cstring>
+#include <mutex>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfCounts &PerfCounts::operator+=(const PerfCounts &counts) {
+    for (int i = 0; i < kPerfCounterNum; i++) {
+        value[i] += counts.value[i];
+    }
+    valid |= counts.valid;
+    return *this;
+}
+
+PerfCounts PerfCounts::operator-(const PerfCounts &counts) const {
+    PerfCounts diff;
+    diff.valid = valid & counts.valid;
+    for (int i = 0; i < kPerfCounterNum; i++) {
+        bool has = diff.Has(static_cast<PerfCounter>(i));
+        diff.value[i] = has ? value[i] - counts.value[i] : 0;
+    }
+    return diff;
+}
+
+const char *PerfCounterName(const PerfCounter &counter) {
+    static const char *names[kPerfCounterNum] = {"cycles", "instructions", "LLC misses",
+                                                 "branch misses"};
+    return names[counter];
+}
+
+#if defined(__linux__)
+
+// One group per thread, led by the cycle counter, so that all counters run (and are
+// multiplexed) together
+struct ThreadPerfCounters {
+    ThreadPerfCounters() {
+        static const uint64_t configs[kPerfCounterNum] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int i = 0; i < kPerfCounterNum; i++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.exclude_kernel = 1; // allowed with perf_event_paranoid up to 2
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                               PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd =
+                static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+            if (fd < 0) {
+                // Without cycles there is no group; other counters may just be missing
+                if (i == kPerfCycles) {
+                    return;
+                }
+                continue;
+            }
+            if (leader < 0) {
+                leader = fd;
+            }
+            fds[i] = fd;
+            ioctl(fd, PERF_EVENT_IOC_ID, &ids[i]);
+        }
+    }
+    ~ThreadPerfCounters() {
+        for (const int &fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    PerfCounts Read() const {
+        PerfCounts counts;
+        // nr, time enabled, time running, then (value, id) per counter
+        uint64_t data[3 + 2 * kPerfCounterNum];
+        if (leader < 0 || read(leader, data, sizeof(data)) <= 0) {
+            return counts;
+        }
+        uint64_t counterNum = data[0], enabled = data[1], running = data[2];
+        // Scale counts up for the time the group was multiplexed out
+        double scale = running > 0 ? static_cast<double>(enabled) / running : 0.0;
+        for (uint64_t j = 0; j < counterNum && j < kPerfCounterNum; j++) {
+            for (int i = 0; i < kPerfCounterNum; i++) {
+                if (fds[i] >= 0 && ids[i] == data[4 + 2 * j]) {
+                    counts.value[i] = static_cast<uint64_t>(data[3 + 2 * j] * scale);
+                    counts.valid |= 1u << i;
+                }
+            }
+        }
+        return counts;
+    }
+
+    int fds[kPerfCounterNum] = {-1, -1, -1, -1};
+    uint64_t ids[kPerfCounterNum] = {};
+    int leader = -1;
+};
+
+bool PerfCountersAvailable() {
+    static bool available = ThreadPerfCounters().leader >= 0;
+    return available;
+}
+
+PerfCounts ReadThreadPerfCounts() {
+    if (!PerfCountersAvailable()) {
+        return PerfCounts();
+    }
+    static thread_local ThreadPerfCounters counters;
+    return counters.Read();
+}
+
+#else
+
+bool PerfCountersAvailable() { return false; }
+
+PerfCounts ReadThreadPerfCounts() { return PerfCounts(); }
+
+#endif
+
+PerfCounts ReadTeamPerfCounts() {
+    PerfCounts sum;
+#ifdef _OPENMP
+    std::mutex mutex;
+    #pragma omp parallel
+    {
+        PerfCounts counts = ReadThreadPerfCounts();
+        std::lock_guard<std::mutex> lock(mutex);
+        sum += counts;
+    }
+#else
+    sum = ReadThreadPerfCounts();
+#endif
+    return sum;
+}
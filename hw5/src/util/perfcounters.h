@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+// Hardware performance counters (Linux perf_event_open) of the threads running a
+// stage, to tell compute-bound from memory-bound stages. Where the counters cannot be
+// opened (other systems, virtual machines without a PMU, perf_event_paranoid) every
+// read comes back without values and callers skip the report.
+
+enum PerfCounter {
+    kPerfCycles,
+    kPerfInstructions,
+    kPerfLlcMisses, // last-level cache misses
+    kPerfBranchMisses,
+    kPerfCounterNum
+};
+
+// Counter values; a counter the CPU does not have stays unset
+struct PerfCounts {
+    uint64_t value[kPerfCounterNum] = {};
+    unsigned valid = 0; // bit i: value[i] was counted
+
+    bool Has(const PerfCounter &counter) const { return (valid >> counter) & 1; }
+    PerfCounts &operator+=(const PerfCounts &counts);
+    PerfCounts operator-(const PerfCounts &counts) const;
+};
+
+// Name of a counter for reports
+const char *PerfCounterName(const PerfCounter &counter);
+
+// Whether the counters can be opened at all, tried once
+bool PerfCountersAvailable();
+
+// Counts of the calling thread since its first read (user space only). The first
+// read opens the thread's counters.
+PerfCounts ReadThreadPerfCounts();
+
+// Sum of ReadThreadPerfCounts over the calling thread and the OpenMP team it starts,
+// the threads its parallel loops run on
+PerfCounts ReadTeamPerfCounts();
+
+// Adds the team's counts between construction and destruction to sink, if enabled
+class PerfScope {
+  public:
+    PerfScope(PerfCounts &sink, const bool &enabled)
+        : m_sink(enabled && PerfCountersAvailable() ? &sink : nullptr) {
+        if (m_sink != nullptr) {
+            m_start = ReadTeamPerfCounts();
+        }
+    }
+    ~PerfScope() {
+        if (m_sink != nullptr) {
+            *m_sink += ReadTeamPerfCounts() - m_start;
+        }
+    }
+    PerfScope(const PerfScope &) = delete;
+    PerfScope &operator=(const PerfScope &) = delete;
+
+  private:
+    PerfCounts *m_sink;
+    PerfCounts m_start;
+};
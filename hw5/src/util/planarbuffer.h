@@ -0,0 +1,169 @@
+#pragma once
+
+#include "buffer.h"
+#include "halfconvert.h"
+#include "mathutil.h"
+
+// Channels are stored as T (float or Half) and always computed with as float
+inline float ChannelToFloat(const float &v) { return v; }
+inline float ChannelToFloat(const Half &v) { return HalfToFloat(v); }
+template <typename T>
+inline T ChannelFromFloat(const float &v);
+template <>
+inline float ChannelFromFloat<float>(const float &v) { return v; }
+template <>
+inline Half ChannelFromFloat<Half>(const float &v) { return FloatToHalf(v); }
+
+// Non-owning view of the three planes of a PlanarBuffer2D, as BufferView2D: no
+// reference counts, no bounds tests (except with DENOISE_DEBUG_CHECKS). T is float or
+// Half, const for read-only views.
+template <typename T>
+struct PlanarView2D {
+    T *Row(const int &channel, const int &y) const {
+        DCHECK(0 <= y && y < m_height);
+        return m_planes[channel] + static_cast<ptrdiff_t>(y) * m_stride;
+    }
+    Float3 operator()(const int &x, const int &y) const {
+        DCHECK(0 <= x && x < m_width && 0 <= y && y < m_height);
+        ptrdiff_t i = static_cast<ptrdiff_t>(y) * m_stride + x;
+        return Float3(ChannelToFloat(m_planes[0][i]), ChannelToFloat(m_planes[1][i]),
+                      ChannelToFloat(m_planes[2][i]));
+    }
+    void Set(const int &x, const int &y, const Float3 &v) const {
+        DCHECK(0 <= x && x < m_width && 0 <= y && y < m_height);
+        ptrdiff_t i = static_cast<ptrdiff_t>(y) * m_stride + x;
+        m_planes[0][i] = ChannelFromFloat<T>(v.x);
+        m_planes[1][i] = ChannelFromFloat<T>(v.y);
+        m_planes[2][i] = ChannelFromFloat<T>(v.z);
+    }
+    // Rectangle [x0, x1) x [y0, y1) of this view, in its coordinates
+    PlanarView2D<T> SubView(const int &x0, const int &y0, const int &x1,
+                            const int &y1) const {
+        DCHECK(0 <= x0 && x0 <= x1 && x1 <= m_width);
+        DCHECK(0 <= y0 && y0 <= y1 && y1 <= m_height);
+        ptrdiff_t offset = static_cast<ptrdiff_t>(y0) * m_stride + x0;
+        return {{m_planes[0] + offset, m_planes[1] + offset, m_planes[2] + offset},
+                x1 - x0, y1 - y0, m_stride};
+    }
+    operator PlanarView2D<const T>() const {
+        return {{m_planes[0], m_planes[1], m_planes[2]}, m_width, m_height, m_stride};
+    }
+
+    T *m_planes[3];
+    int m_width, m_height;
+    int m_stride; // elements from one row to the next
+};
+
+// Three-channel 2D buffer stored as structure of arrays: one kBufferAlignment-aligned
+// plane per channel, so kernels can load a run of pixels of one channel contiguously.
+// T is float, or Half to halve the memory and bandwidth of a buffer; pixels are read
+// and written as Float3 either way.
+template <typename T>
+class PlanarBuffer2D {
+  public:
+    PlanarBuffer2D();
+    PlanarBuffer2D(const Buffer2D<T> &x, const Buffer2D<T> &y, const Buffer2D<T> &z);
+
+    void Copy(const PlanarBuffer2D<T> &buffer);
+
+    Float3 operator()(const int &x, const int &y) const;
+    void Set(const int &x, const int &y, const Float3 &v);
+
+    T *Plane(const int &channel) { return m_planes[channel].m_buffer.get(); }
+    const T *Plane(const int &channel) const { return m_planes[channel].m_buffer.get(); }
+
+    PlanarView2D<T> View() {
+        return {{Plane(0), Plane(1), Plane(2)}, m_width, m_height, m_width};
+    }
+    PlanarView2D<const T> View() const {
+        return {{Plane(0), Plane(1), Plane(2)}, m_width, m_height, m_width};
+    }
+
+    Buffer2D<T> m_planes[3];
+    int m_width, m_height;
+};
+
+template <typename T>
+inline PlanarBuffer2D<T>::PlanarBuffer2D() : m_width(0), m_height(0) {}
+
+template <typename T>
+inline PlanarBuffer2D<T>::PlanarBuffer2D(const Buffer2D<T> &x, const Buffer2D<T> &y,
+                                         const Buffer2D<T> &z)
+    : m_planes{x, y, z}, m_width(x.m_width), m_height(x.m_height) {
+    CHECK(y.m_width == m_width && y.m_height == m_height);
+    CHECK(z.m_width == m_width && z.m_height == m_height);
+}
+
+template <typename T>
+inline void PlanarBuffer2D<T>::Copy(const PlanarBuffer2D<T> &buffer) {
+    for (int c = 0; c < 3; c++) {
+        m_planes[c].Copy(buffer.m_planes[c]);
+    }
+    m_width = buffer.m_width;
+    m_height = buffer.m_height;
+}
+
+template <typename T>
+inline Float3 PlanarBuffer2D<T>::operator()(const int &x, const int &y) const {
+    if (0 <= x && x < m_width && 0 <= y && y < m_height) {
+        int i = y * m_width + x;
+        return Float3(ChannelToFloat(m_planes[0].m_buffer[i]),
+                      ChannelToFloat(m_planes[1].m_buffer[i]),
+                      ChannelToFloat(m_planes[2].m_buffer[i]));
+    } else {
+        return Float3(0.f);
+    }
+}
+
+template <typename T>
+inline void PlanarBuffer2D<T>::Set(const int &x, const int &y, const Float3 &v) {
+    CHECK(0 <= x && x < m_width && 0 <= y && y < m_height);
+    int i = y * m_width + x;
+    m_planes[0].m_buffer[i] = ChannelFromFloat<T>(v.x);
+    m_planes[1].m_buffer[i] = ChannelFromFloat<T>(v.y);
+    m_planes[2].m_buffer[i] = ChannelFromFloat<T>(v.z);
+}
+
+template <typename T>
+inline PlanarBuffer2D<T> CreatePlanarBuffer2D(const int &width, const int &height) {
+    return PlanarBuffer2D<T>(CreateBuffer2D<T>(width, height),
+                             CreateBuffer2D<T>(width, height),
+                             CreateBuffer2D<T>(width, height));
+}
+
+// Convert src into dst, which must have the same size
+inline void ConvertPlanes(const PlanarBuffer2D<float> &src, PlanarBuffer2D<Half> &dst) {
+    for (int c = 0; c < 3; c++) {
+        FloatToHalf(src.Plane(c), dst.Plane(c),
+                    static_cast<size_t>(src.m_width) * src.m_height);
+    }
+}
+inline void ConvertPlanes(const PlanarBuffer2D<Half> &src, PlanarBuffer2D<float> &dst) {
+    for (int c = 0; c < 3; c++) {
+        HalfToFloat(src.Plane(c), dst.Plane(c),
+                    static_cast<size_t>(src.m_width) * src.m_height);
+    }
+}
+template <typename T>
+inline void ConvertPlanes(const PlanarBuffer2D<T> &src, PlanarBuffer2D<T> &dst) {
+    for (int c = 0; c < 3; c++) {
+        std::memcpy(dst.Plane(c), src.Plane(c),
+                    sizeof(T) * static_cast<size_t>(src.m_width) * src.m_height);
+    }
+}
+
+// Convert count channel values, such as one row of a plane
+inline void ConvertChannels(const float *src, Half *dst, const size_t &count) {
+    FloatToHalf(src, dst, count);
+}
+inline void ConvertChannels(const float *src, float *dst, const size_t &count) {
+    std::memcpy(dst, src, sizeof(float) * count);
+}
+
+// Copy of src stored as Dst, converted a plane at a time (SIMD for float <-> Half)
+template <typename Dst, typename Src>
+inline PlanarBuffer2D<Dst> ConvertPlanarBuffer2D(const PlanarBuffer2D<Src> &src) {
+    PlanarBuffer2D<Dst> dst = CreatePlanarBuffer2D<Dst>(src.m_width, src.m_height);
+    ConvertPlanes(src, dst);
+    return dst;
+}
@@ -0,0 +1,107 @@
+#include "simdutil.h"
+
+#if SIMD_X86 && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#elif SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#endif
+
+static SimdLevel QuerySimdLevel() {
+#if SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SimdLevel::SSE4;
+    }
+    return SimdLevel::Scalar;
+#elif SIMD_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse4 = (info[2] & (1 << 19)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    // The OS must save the YMM (and ZMM) state on context switches
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool osAvx = (xcr0 & 0x6) == 0x6;
+    bool osAvx512 = (xcr0 & 0xe6) == 0xe6;
+    bool avx2 = false, avx512 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512 = (info[1] & (1 << 16)) != 0;
+    }
+    if (avx512 && avx2 && fma && osAvx512) {
+        return SimdLevel::AVX512;
+    }
+    if (avx2 && fma && osAvx) {
+        return SimdLevel::AVX2;
+    }
+    return sse4 ? SimdLevel::SSE4 : SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel DetectSimdLevel() {
+    static const SimdLevel level = QuerySimdLevel();
+    return level;
+}
+
+static bool QueryF16C() {
+#if SIMD_X86
+    unsigned int ecx = 0;
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    ecx = static_cast<unsigned int>(info[2]);
+#else
+    unsigned int eax, ebx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+#endif
+    bool f16c = (ecx & (1u << 29)) != 0;
+    bool osxsave = (ecx & (1u << 27)) != 0;
+    if (!f16c || !osxsave) {
+        return false;
+    }
+#if defined(_MSC_VER)
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    unsigned long long xcr0 = xcr0Low;
+#endif
+    return (xcr0 & 0x6) == 0x6;
+#else
+    return false;
+#endif
+}
+
+bool CpuSupportsF16C() {
+    static const bool f16c = QueryF16C();
+    return f16c;
+}
+
+const char *SimdLevelName(const SimdLevel &level) {
+    switch (level) {
+    case SimdLevel::SSE4:
+        return "SSE4";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::AVX512:
+        return "AVX-512";
+    case SimdLevel::Scalar:
+    default:
+        return "Scalar";
+    }
+}
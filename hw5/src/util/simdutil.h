@@ -0,0 +1,18 @@
+#pragma once
+
+// Instruction sets the vectorized kernels are built for. Ordered, so a level
+// implies every level below it.
+enum class SimdLevel { Scalar, SSE4, AVX2, AVX512 };
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+// Best level supported by both the CPU and the OS, detected once
+SimdLevel DetectSimdLevel();
+const char *SimdLevelName(const SimdLevel &level);
+
+// F16C half/float conversions, with the OS saving the AVX state they need
+bool CpuSupportsF16C();
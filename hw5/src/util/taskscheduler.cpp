@@ -0,0 +1,195 @@
+#include "taskscheduler.h"
+#include "trace.h"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+void TaskGraph::Clear() {
+    m_tasks.clear();
+    m_edges.clear();
+}
+
+int TaskGraph::AddTask(const TaskFunc &func, const void *context, const int &index) {
+    m_tasks.push_back({func, context, index});
+    return static_cast<int>(m_tasks.size()) - 1;
+}
+
+void TaskGraph::AddEdge(const int &before, const int &after) {
+    m_edges.push_back({before, after});
+}
+
+void TaskGraph::Build() {
+    int taskNum = TaskCount();
+    if (m_pendingCapacity < taskNum) {
+        m_pending.reset(new std::atomic<int>[taskNum]);
+        m_pendingCapacity = taskNum;
+    }
+    for (int i = 0; i < taskNum; i++) {
+        m_pending[i].store(0, std::memory_order_relaxed);
+    }
+
+    // Counting sort of the edges by their first task
+    m_successorBegin.assign(taskNum + 1, 0);
+    for (const std::pair<int, int> &edge : m_edges) {
+        m_successorBegin[edge.first + 1]++;
+        m_pending[edge.second].fetch_add(1, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < taskNum; i++) {
+        m_successorBegin[i + 1] += m_successorBegin[i];
+    }
+    m_successors.resize(m_edges.size());
+    for (const std::pair<int, int> &edge : m_edges) {
+        m_successors[m_successorBegin[edge.first]++] = edge.second;
+    }
+    for (int i = taskNum; i > 0; i--) {
+        m_successorBegin[i] = m_successorBegin[i - 1];
+    }
+    m_successorBegin[0] = 0;
+}
+
+TaskScheduler::TaskScheduler(const int &threads) {
+    int threadNum = threads;
+    if (threadNum <= 0) {
+#ifdef _OPENMP
+        threadNum = omp_get_max_threads();
+#else
+        threadNum = static_cast<int>(std::thread::hardware_concurrency());
+#endif
+    }
+    threadNum = std::max(threadNum, 1);
+    for (int i = 0; i < threadNum; i++) {
+        m_queues.emplace_back(new Queue);
+    }
+    for (int i = 0; i < threadNum; i++) {
+        m_threads.emplace_back(&TaskScheduler::WorkerMain, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void TaskScheduler::Run(TaskGraph &graph) {
+    int taskNum = graph.TaskCount();
+    if (taskNum == 0) {
+        return;
+    }
+    graph.Build();
+    graph.m_remaining.store(taskNum, std::memory_order_relaxed);
+
+    // Tasks without predecessors are dealt out in order, so that the first ones of
+    // every worker are neighbours. Workers pop from the tail, so every queue gets
+    // its share last task first.
+    int ready = 0;
+    for (int task = 0; task < taskNum; task++) {
+        if (graph.m_pending[task].load(std::memory_order_relaxed) == 0) {
+            ready++;
+        }
+    }
+    int perThread = (ready + ThreadCount() - 1) / ThreadCount();
+    for (int task = taskNum - 1; task >= 0; task--) {
+        if (graph.m_pending[task].load(std::memory_order_relaxed) == 0) {
+            Push(--ready / perThread, {&graph, task});
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_runs++;
+    m_start.notify_all();
+    // The graph is only handed back once no worker can touch it any more
+    m_done.wait(lock, [&]() {
+        return graph.m_remaining.load(std::memory_order_acquire) == 0;
+    });
+    m_runs--;
+}
+
+void TaskScheduler::WorkerMain(const int &worker) {
+    SetTraceThreadName("task worker " + std::to_string(worker));
+    for (;;) {
+        Entry entry;
+        if (Pop(worker, entry) || Steal(worker, entry)) {
+            Execute(worker, entry);
+        } else if (m_runs.load(std::memory_order_acquire) > 0) {
+            std::this_thread::yield();
+        } else {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&]() { return m_stop || m_runs > 0; });
+            if (m_stop) {
+                return;
+            }
+        }
+    }
+}
+
+void TaskScheduler::Execute(const int &worker, const Entry &entry) {
+    TaskGraph &graph = *entry.graph;
+    const TaskGraph::Task &t = graph.m_tasks[entry.task];
+    t.func(t.context, t.index);
+    int successorEnd = graph.m_successorBegin[entry.task + 1];
+    for (int i = graph.m_successorBegin[entry.task]; i < successorEnd; i++) {
+        int successor = graph.m_successors[i];
+        if (graph.m_pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Push(worker, {&graph, successor});
+        }
+    }
+    // Run may return as soon as the count drops to zero, graph is not touched after.
+    // Taking m_mutex orders the wake-up after its check of the count.
+    if (graph.m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done.notify_all();
+    }
+}
+
+void TaskScheduler::Push(const int &worker, const Entry &entry) {
+    Queue &queue = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tail == static_cast<int>(queue.tasks.size())) {
+        // Move the live tasks to the front, or grow if there is no room either way
+        std::copy(queue.tasks.begin() + queue.head, queue.tasks.begin() + queue.tail,
+                  queue.tasks.begin());
+        queue.tail -= queue.head;
+        queue.head = 0;
+        if (queue.tail == static_cast<int>(queue.tasks.size())) {
+            queue.tasks.resize(std::max<size_t>(2 * queue.tasks.size(), 64));
+        }
+    }
+    queue.tasks[queue.tail++] = entry;
+}
+
+bool TaskScheduler::Pop(const int &worker, Entry &entry) {
+    Queue &queue = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tail == queue.head) {
+        return false;
+    }
+    entry = queue.tasks[--queue.tail];
+    return true;
+}
+
+bool TaskScheduler::Steal(const int &worker, Entry &entry) {
+    int queueNum = ThreadCount();
+    for (int i = 1; i < queueNum; i++) {
+        Queue &queue = *m_queues[(worker + i) % queueNum];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tail != queue.head) {
+            entry = queue.tasks[queue.head++];
+            return true;
+        }
+    }
+    return false;
+}
+
+TaskScheduler &GetTaskScheduler() {
+    static TaskScheduler scheduler;
+    return scheduler;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Task of a TaskGraph: func(context, index)
+typedef void (*TaskFunc)(const void *context, const int &index);
+
+// Tasks and the dependency edges between them. A graph is cleared and rebuilt for
+// every run; its storage is kept, so rebuilding one of the same shape does not
+// allocate.
+class TaskGraph {
+  public:
+    void Clear();
+    // Id of the new task
+    int AddTask(const TaskFunc &func, const void *context, const int &index);
+    // Task after starts only once task before has finished
+    void AddEdge(const int &before, const int &after);
+    int TaskCount() const { return static_cast<int>(m_tasks.size()); }
+
+  private:
+    friend class TaskScheduler;
+
+    struct Task {
+        TaskFunc func;
+        const void *context;
+        int index;
+    };
+    // Successor lists and predecessor counts from m_edges
+    void Build();
+
+    std::vector<Task> m_tasks;
+    std::vector<std::pair<int, int>> m_edges;
+    // Successors of task i are m_successors[m_successorBegin[i], m_successorBegin[i+1])
+    std::vector<int> m_successorBegin;
+    std::vector<int> m_successors;
+    // Unfinished predecessors of every task while the graph runs
+    std::unique_ptr<std::atomic<int>[]> m_pending;
+    int m_pendingCapacity = 0;
+    std::atomic<int> m_remaining{0}; // tasks not finished yet while the graph runs
+};
+
+// Persistent worker threads running task graphs. Every worker owns a deque of ready
+// tasks: it pushes the tasks its own task releases and pops them again newest
+// first, while idle workers steal the oldest ones from the others. A task starts as
+// soon as its own predecessors are done, there is no barrier between groups of tasks.
+// Graphs run from several threads at once (e.g. the filter of one frame and the
+// temporal passes of the frame before) share the workers the same way.
+class TaskScheduler {
+  public:
+    // Worker threads; 0 takes one per OpenMP thread (or hardware thread without
+    // OpenMP)
+    explicit TaskScheduler(const int &threads = 0);
+    ~TaskScheduler();
+
+    // Run every task of graph after its predecessors on the workers and return once
+    // all have finished; the calling thread sleeps meanwhile. Not reentrant: tasks
+    // must not call Run.
+    void Run(TaskGraph &graph);
+    int ThreadCount() const { return static_cast<int>(m_queues.size()); }
+
+  private:
+    struct Entry {
+        TaskGraph *graph;
+        int task;
+    };
+    // Ready tasks of one worker between a head (steal end) and a tail (owner end).
+    // The array only grows while more tasks are ready at once than ever before.
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Entry> tasks;
+        int head = 0, tail = 0;
+    };
+
+    void WorkerMain(const int &worker);
+    void Execute(const int &worker, const Entry &entry);
+    void Push(const int &worker, const Entry &entry);
+    bool Pop(const int &worker, Entry &entry);
+    bool Steal(const int &worker, Entry &entry);
+
+    std::vector<std::unique_ptr<Queue>> m_queues; // one per worker
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_start, m_done;
+    std::atomic<int> m_runs{0}; // graphs running, changed under m_mutex
+    bool m_stop = false;
+};
+
+// Scheduler shared by all denoisers, created on first use
+TaskScheduler &GetTaskScheduler();
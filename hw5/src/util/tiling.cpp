@@ -0,0 +1,54 @@
+#include "tiling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+std::vector<Tile> MakeTiles(const int &width, const int &height, const int &tileSize) {
+    std::vector<Tile> tiles;
+    MakeTiles(width, height, tileSize, tiles);
+    return tiles;
+}
+
+void MakeTiles(const int &width, const int &height, const int &tileSize,
+               std::vector<Tile> &tiles) {
+    tiles.clear();
+    if (tileSize <= 0) {
+        tiles.reserve(height);
+        for (int y = 0; y < height; y++) {
+            tiles.push_back({0, y, width, y + 1});
+        }
+        return;
+    }
+
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+    tiles.reserve(tilesX * tilesY);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            int x0 = tx * tileSize, y0 = ty * tileSize;
+            tiles.push_back({x0, y0, std::min(width, x0 + tileSize),
+                             std::min(height, y0 + tileSize)});
+        }
+    }
+}
+
+int ChooseTileSize(const int &haloRadius, const int &bytesPerPixel) {
+    double budget = 0.5 * GetL2CacheSize() / bytesPerPixel;
+    int edge = static_cast<int>(std::sqrt(budget)) - 2 * haloRadius;
+    return std::max(16, edge / 16 * 16);
+}
+
+size_t GetL2CacheSize() {
+    size_t size = 0;
+#if defined(__linux__) && defined(_SC_LEVEL2_CACHE_SIZE)
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l2 > 0) {
+        size = static_cast<size_t>(l2);
+    }
+#endif
+    return size > 0 ? size : 256 * 1024;
+}
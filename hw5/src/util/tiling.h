@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Block of pixels [x0, x1) x [y0, y1)
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+// Split a width x height image into tileSize x tileSize tiles (clipped at the
+// borders). A tileSize of 0 yields one full-width tile per row.
+std::vector<Tile> MakeTiles(const int &width, const int &height, const int &tileSize);
+// Same into tiles, reusing its storage
+void MakeTiles(const int &width, const int &height, const int &tileSize,
+               std::vector<Tile> &tiles);
+
+// Run func(index) for every tile of MakeTiles(width, height, tileSize) that overlaps
+// the rectangle [x0, x1) x [y0, y1), which may reach past the image
+template <typename Func>
+inline void ForTilesOverlapping(const int &width, const int &height,
+                                const int &tileSize, const int &x0, const int &y0,
+                                const int &x1, const int &y1, const Func &func) {
+    int cx0 = std::max(x0, 0), cy0 = std::max(y0, 0);
+    int cx1 = std::min(x1, width), cy1 = std::min(y1, height);
+    if (cx0 >= cx1 || cy0 >= cy1) {
+        return;
+    }
+    if (tileSize <= 0) {
+        for (int y = cy0; y < cy1; y++) {
+            func(y);
+        }
+        return;
+    }
+    int tilesX = (width + tileSize - 1) / tileSize;
+    for (int ty = cy0 / tileSize; ty <= (cy1 - 1) / tileSize; ty++) {
+        for (int tx = cx0 / tileSize; tx <= (cx1 - 1) / tileSize; tx++) {
+            func(ty * tilesX + tx);
+        }
+    }
+}
+
+// Largest tile edge (multiple of 16, at least 16) such that the tile plus a halo of
+// haloRadius pixels on every side, at bytesPerPixel, fills at most half of L2
+int ChooseTileSize(const int &haloRadius, const int &bytesPerPixel);
+
+// Per-core L2 size in bytes, 256 KiB if it cannot be queried
+size_t GetL2CacheSize();
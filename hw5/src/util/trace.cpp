@@ -0,0 +1,127 @@
+#include "trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> g_traceEnabled(false);
+
+struct TraceEvent {
+    const char *name;
+    int frame;
+    int64_t start, end;
+};
+
+struct ThreadTrace {
+    int tid;
+    std::string name;
+    std::vector<TraceEvent> events;
+};
+
+struct TraceState {
+    std::mutex mutex;
+    // Buffers outlive their threads, so the events of finished threads are kept
+    std::vector<std::unique_ptr<ThreadTrace>> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+
+// Leaked, so threads still running at exit never touch a destroyed state
+static TraceState &GetTraceState() {
+    static TraceState *state = new TraceState;
+    return *state;
+}
+
+static thread_local ThreadTrace *t_threadTrace = nullptr;
+
+static ThreadTrace &GetThreadTrace() {
+    if (t_threadTrace == nullptr) {
+        TraceState &state = GetTraceState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.threads.emplace_back(new ThreadTrace);
+        t_threadTrace = state.threads.back().get();
+        t_threadTrace->tid = static_cast<int>(state.threads.size());
+        t_threadTrace->events.reserve(1024);
+    }
+    return *t_threadTrace;
+}
+
+// Characters of a trace name that JSON needs escaped are dropped
+static std::string JsonString(const std::string &s) {
+    std::string out = "\"";
+    for (const char &c : s) {
+        if (c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20) {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void StartTrace() {
+    TraceState &state = GetTraceState();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (std::unique_ptr<ThreadTrace> &thread : state.threads) {
+            thread->events.clear();
+        }
+        state.start = std::chrono::steady_clock::now();
+    }
+    g_traceEnabled = true;
+}
+
+bool WriteTrace(const std::string &filename) {
+    g_traceEnabled = false;
+    std::ofstream os(filename);
+    if (!os.is_open()) {
+        return false;
+    }
+
+    TraceState &state = GetTraceState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    // Complete events ("X") in microseconds, one track per thread
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    os << std::fixed << std::setprecision(3);
+    for (const std::unique_ptr<ThreadTrace> &thread : state.threads) {
+        if (thread->events.empty()) {
+            continue;
+        }
+        std::string name =
+            thread->name.empty() ? "thread " + std::to_string(thread->tid) : thread->name;
+        os << (first ? "\n" : ",\n")
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->tid
+           << ",\"args\":{\"name\":" << JsonString(name) << "}}";
+        first = false;
+        for (const TraceEvent &event : thread->events) {
+            os << ",\n{\"name\":" << JsonString(event.name)
+               << ",\"cat\":\"denoise\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->tid
+               << ",\"ts\":" << event.start / 1000.0
+               << ",\"dur\":" << (event.end - event.start) / 1000.0;
+            if (event.frame >= 0) {
+                os << ",\"args\":{\"frame\":" << event.frame << "}";
+            }
+            os << "}";
+        }
+    }
+    os << "\n]}\n";
+    return static_cast<bool>(os);
+}
+
+void SetTraceThreadName(const std::string &name) {
+    if (TraceEnabled()) {
+        GetThreadTrace().name = name;
+    }
+}
+
+int64_t TraceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - GetTraceState().start)
+        .count();
+}
+
+void RecordTraceEvent(const char *name, const int &frame, const int64_t &start,
+                      const int64_t &end) {
+    GetThreadTrace().events.push_back({name, frame, start, end});
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped trace markers, written as a Chrome trace-event JSON file (chrome://tracing,
+// ui.perfetto.dev). Every thread records into its own buffer; while tracing is off a
+// marker costs one relaxed load and a branch.
+
+extern std::atomic<bool> g_traceEnabled;
+
+inline bool TraceEnabled() { return g_traceEnabled.load(std::memory_order_relaxed); }
+
+// Drop the events so far and start recording
+void StartTrace();
+// Stop recording and write the events of every thread to filename. Call once the
+// traced threads are done (or idle), their buffers are read without locking.
+bool WriteTrace(const std::string &filename);
+// Name of the calling thread in the trace, if tracing
+void SetTraceThreadName(const std::string &name);
+
+// Nanoseconds since StartTrace
+int64_t TraceNow();
+// Event of the calling thread; name must outlive the trace (a string literal)
+void RecordTraceEvent(const char *name, const int &frame, const int64_t &start,
+                      const int64_t &end);
+
+// Event from construction to destruction, with the frame index as argument unless
+// it is negative
+class TraceScope {
+  public:
+    explicit TraceScope(const char *name, const int &frame = -1)
+        : m_name(name), m_frame(frame), m_start(TraceEnabled() ? TraceNow() : -1) {}
+    ~TraceScope() {
+        if (m_start >= 0) {
+            RecordTraceEvent(m_name, m_frame, m_start, TraceNow());
+        }
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+  private:
+    const char *m_name;
+    int m_frame;
+    int64_t m_start; // -1 when tracing was off
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Trace the rest of the enclosing scope as name (of frame)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FRAME_SCOPE(name, frame)                                                  \
+    TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, frame)
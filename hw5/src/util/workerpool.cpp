@@ -0,0 +1,40 @@
+#include "workerpool.h"
+#include "trace.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(const int &threads, const std::string &name) {
+    for (int i = 0; i < std::max(threads, 1); i++) {
+        m_threads.emplace_back(&WorkerPool::WorkerMain, this,
+                               name + " " + std::to_string(i));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_pushedJob.notify_all();
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::WorkerMain(const std::string &name) {
+    SetTraceThreadName(name);
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_pushedJob.wait(lock, [&]() { return m_stop || !m_jobs.empty(); });
+            // Jobs still queued at destruction run first
+            if (m_jobs.empty()) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        job();
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Persistent threads running submitted jobs in submission order, for the frame loads
+// and writes that overlap the denoiser. Unlike a std::async per job, no thread is
+// started or torn down per frame.
+class WorkerPool {
+  public:
+    // threads are named "name i" in traces
+    WorkerPool(const int &threads, const std::string &name);
+    // Finishes the jobs submitted so far
+    ~WorkerPool();
+
+    // Run func() on a worker; the future holds its result
+    template <typename F>
+    std::future<decltype(std::declval<F>()())> Submit(F func) {
+        typedef decltype(func()) R;
+        // std::function needs a copyable callable, packaged_task is move-only
+        std::shared_ptr<std::packaged_task<R()>> task =
+            std::make_shared<std::packaged_task<R()>>(std::move(func));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back([task]() { (*task)(); });
+        }
+        m_pushedJob.notify_one();
+        return result;
+    }
+
+  private:
+    void WorkerMain(const std::string &name);
+
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_pushedJob;
+    bool m_stop = false;
+    std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,95 @@
+#include "worklist.h"
+#include "gbuffer.h"
+
+#include <algorithm>
+
+// Spans of the pixels of the tiles that are not background by isBackground(ID)
+template <typename T, typename IsBackground>
+static void BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                          const Buffer2D<T> *id, const IsBackground &isBackground,
+                          WorkList &workList) {
+    workList.m_spans.clear();
+    workList.m_chunkBegin.clear();
+    workList.m_rowBegin.clear();
+    workList.m_tileBegin.clear();
+    workList.m_pixelCount = 0;
+    for (const Tile &tile : tiles) {
+        workList.m_tileBegin.push_back(static_cast<int>(workList.m_spans.size()));
+        for (int y = tile.y0; y < tile.y1; y++) {
+            if (id == nullptr) {
+                workList.m_spans.push_back({y, tile.x0, tile.x1});
+                workList.m_pixelCount += tile.x1 - tile.x0;
+                continue;
+            }
+            const T *row = id->m_buffer.get() + y * id->m_width;
+            int x = tile.x0;
+            while (x < tile.x1) {
+                while (x < tile.x1 && isBackground(row[x])) x++;
+                int x0 = x;
+                while (x < tile.x1 && !isBackground(row[x])) x++;
+                if (x > x0) {
+                    workList.m_spans.push_back({y, x0, x});
+                    workList.m_pixelCount += x - x0;
+                }
+            }
+        }
+    }
+
+    workList.m_tileBegin.push_back(static_cast<int>(workList.m_spans.size()));
+
+    // Chunks of about equal pixel count, ~256 of them so threads can balance
+    long long target = std::max(1024LL, workList.m_pixelCount / 256);
+    long long pixels = 0;
+    workList.m_chunkBegin.push_back(0);
+    for (int i = 0; i < static_cast<int>(workList.m_spans.size()); i++) {
+        const Span &span = workList.m_spans[i];
+        pixels += span.x1 - span.x0;
+        if (pixels >= target) {
+            workList.m_chunkBegin.push_back(i + 1);
+            pixels = 0;
+        }
+    }
+    if (workList.m_chunkBegin.back() != static_cast<int>(workList.m_spans.size())) {
+        workList.m_chunkBegin.push_back(static_cast<int>(workList.m_spans.size()));
+    }
+
+    // Row index, if the spans came out in row order
+    bool rowOrder = true;
+    for (size_t i = 1; i < workList.m_spans.size() && rowOrder; i++) {
+        rowOrder = workList.m_spans[i - 1].y <= workList.m_spans[i].y;
+    }
+    if (rowOrder) {
+        workList.m_rowBegin.assign(height + 1, 0);
+        for (const Span &span : workList.m_spans) {
+            workList.m_rowBegin[span.y + 1]++;
+        }
+        for (int y = 0; y < height; y++) {
+            workList.m_rowBegin[y + 1] += workList.m_rowBegin[y];
+        }
+    }
+}
+
+void BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                   const Buffer2D<float> *id, WorkList &workList) {
+    BuildWorkList(tiles, height, id, [](const float &v) { return v < 0; }, workList);
+}
+
+void BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                   const Buffer2D<uint16_t> *id, WorkList &workList) {
+    BuildWorkList(tiles, height, id, [](const uint16_t &v) { return v == kBackgroundId; },
+                  workList);
+}
+
+WorkList BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                       const Buffer2D<float> *id) {
+    WorkList workList;
+    BuildWorkList(tiles, height, id, workList);
+    return workList;
+}
+
+WorkList BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                       const Buffer2D<uint16_t> *id) {
+    WorkList workList;
+    BuildWorkList(tiles, height, id, workList);
+    return workList;
+}
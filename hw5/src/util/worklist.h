@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "buffer.h"
+#include "tiling.h"
+
+// Run of pixels [x0, x1) of row y
+struct Span {
+    int y, x0, x1;
+};
+
+// Compacted list of the pixels a pass has to visit, as spans grouped tile by tile,
+// split into chunks of roughly equal pixel count for load balancing
+class WorkList {
+  public:
+    // Spans of row y, only if the list was built from whole-row tiles
+    const Span *RowBegin(const int &y) const { return m_spans.data() + m_rowBegin[y]; }
+    const Span *RowEnd(const int &y) const { return m_spans.data() + m_rowBegin[y + 1]; }
+
+    std::vector<Span> m_spans;
+    // Chunk i is spans [m_chunkBegin[i], m_chunkBegin[i+1])
+    std::vector<int> m_chunkBegin;
+    std::vector<int> m_rowBegin;  // empty unless the spans are in row order
+    std::vector<int> m_tileBegin; // tile i is spans [m_tileBegin[i], m_tileBegin[i+1])
+    long long m_pixelCount = 0;
+};
+
+// Spans covering the tiles. With an ID buffer, only pixels with ID >= 0 (not
+// background) are kept and tiles without any of them drop out.
+WorkList BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                       const Buffer2D<float> *id);
+// Same for compact IDs, background is kBackgroundId
+WorkList BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                       const Buffer2D<uint16_t> *id);
+// Both into workList, reusing its storage
+void BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                   const Buffer2D<float> *id, WorkList &workList);
+void BuildWorkList(const std::vector<Tile> &tiles, const int &height,
+                   const Buffer2D<uint16_t> *id, WorkList &workList);
+
+// Run func(span) for every span, distributing chunks over the OpenMP threads
+template <typename Func>
+inline void ParallelForSpans(const WorkList &workList, const Func &func) {
+    int chunkNum = static_cast<int>(workList.m_chunkBegin.size()) - 1;
+    #pragma omp parallel for schedule(dynamic)
+    for (int chunk = 0; chunk < chunkNum; chunk++) {
+        for (int i = workList.m_chunkBegin[chunk]; i < workList.m_chunkBegin[chunk + 1];
+             i++) {
+            func(workList.m_spans[i]);
+        }
+    }
+}